@@ -0,0 +1,150 @@
+/* rirc-fuzz-parse ~ fuzz the protocol layer
+ *
+ * Inputs are passed to io_cb_read_soc as received lines, parsed and
+ * dispatched to a registered server. Drawing is sunk to /dev/null and
+ * sent lines are discarded, see bench/sink.h.
+ *
+ * libFuzzer:
+ *   make fuzz-parse
+ *
+ * AFL, or reproducing a single input from stdin, build with -DFUZZ_STDIN:
+ *   afl-clang-fast -DFUZZ_STDIN ...
+ *   afl-fuzz -i bench/fuzz -o build/fuzz -- ./rirc-fuzz-parse
+ *
+ * Seed inputs are in bench/fuzz */
+
+#include "bench/sink.h"
+#include "src/draw.h"
+#include "src/io.h"
+#include "src/rirc.h"
+#include "src/state.h"
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Inputs per client state, bounding state accumulated across inputs */
+#define FUZZ_RESET 1024
+
+#define FUZZ_COLS 120
+#define FUZZ_ROWS 40
+
+int LLVMFuzzerInitialize(int*, char***);
+int LLVMFuzzerTestOneInput(const uint8_t*, size_t);
+
+static void fuzz_init(void);
+static void fuzz_term(void);
+
+const char *runtime_name = "rirc-fuzz-parse";
+
+static struct server *fuzz_server;
+
+static void
+fuzz_init(void)
+{
+	state_init();
+	draw_init();
+	io_cb_sigwinch(FUZZ_COLS, FUZZ_ROWS);
+
+	fuzz_server = server("fuzz", "6667", NULL, default_username, default_realname);
+
+	if (server_set_nicks(fuzz_server, "rirc"))
+		fatal("server_set_nicks");
+
+	if (server_list_add(state_server_list(), fuzz_server))
+		fatal("server_list_add");
+
+	channel_set_current(fuzz_server->channel);
+
+	io_cb_cxed(fuzz_server);
+}
+
+static void
+fuzz_term(void)
+{
+	draw_term();
+	state_term();
+}
+
+int
+LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	UNUSED(argc);
+	UNUSED(argv);
+
+	if (!freopen("/dev/null", "w", stdout))
+		fatal("freopen: %s", strerror(errno));
+
+	fuzz_init();
+
+	return 0;
+}
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	/* Received lines are always terminated */
+
+	static unsigned long n;
+	char *buf;
+
+	if (size == 0)
+		return 0;
+
+	if (!(buf = malloc(size + 1)))
+		fatal("malloc: %s", strerror(errno));
+
+	memcpy(buf, data, size);
+
+	if (buf[size - 1] != '\n')
+		buf[size++] = '\n';
+
+	io_cb_read_soc(buf, size, fuzz_server);
+
+	free(buf);
+
+	if (++n % FUZZ_RESET == 0) {
+		fuzz_term();
+		fuzz_init();
+	}
+
+	return 0;
+}
+
+#ifdef FUZZ_STDIN
+int
+main(void)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	size_t size = 0;
+	size_t ret;
+
+	if (LLVMFuzzerInitialize(NULL, NULL))
+		return EXIT_FAILURE;
+
+	for (;;) {
+
+		if (len == size) {
+			size = (size ? size * 2 : (1 << 16));
+			if (!(buf = realloc(buf, size)))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		if (!(ret = fread(buf + len, 1, size - len, stdin)))
+			break;
+
+		len += ret;
+	}
+
+	LLVMFuzzerTestOneInput((const uint8_t *)buf, len);
+
+	free(buf);
+
+	fuzz_term();
+
+	return EXIT_SUCCESS;
+}
+#endif
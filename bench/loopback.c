@@ -0,0 +1,378 @@
+/* rirc-bench-loopback ~ drive the client through an in-process server
+ *
+ * The client is run as rirc runs it, through io.c, connected over the
+ * loopback transport to a fake server on its own thread. After
+ * registration the server sends a burst of channel traffic followed by
+ * a PING, the client is stopped when its PONG is read back, such that
+ * every line was framed, parsed, handled and drawn.
+ *
+ * The terminal is a pseudoterminal, drawing is sunk to /dev/null.
+ *
+ * Reports messages per second and CPU time per message, CPU time
+ * includes the server thread */
+
+#define _XOPEN_SOURCE 600
+
+#include "src/io.h"
+#include "src/draw.h"
+#include "src/rirc.h"
+#include "src/state.h"
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOOPBACK_COLS 120
+#define LOOPBACK_ROWS 40
+
+#define LOOPBACK_CHANS 4
+#define LOOPBACK_NICKS 16
+#define LOOPBACK_TOKEN "rirc-bench-loopback"
+
+#define LOOPBACK_TV_US(TV) ((double)(TV).tv_sec * 1e6 + (double)(TV).tv_usec)
+
+static char* loopback_recv(void);
+static double loopback_now_us(void);
+static int loopback_send(const char*, size_t);
+static void loopback_accept(int, void*);
+static void loopback_traffic(const char*);
+static void loopback_tty(void);
+static void loopback_usage(void);
+static void* loopback_server(void*);
+
+const char *ca_cert_path;
+const char *capture_dir;
+const char *default_username = "rirc";
+const char *default_realname = "rirc";
+const char *runtime_name = "rirc-bench-loopback";
+int io_uring_enabled;
+
+static struct {
+	char *buf;
+	size_t len;
+	size_t size;
+	unsigned long n;
+} traffic;
+
+static struct {
+	char buf[1024];
+	size_t len;
+	double t0;
+	double t1;
+	int soc;
+} server_st;
+
+static char*
+loopback_recv(void)
+{
+	/* Read the next line from the client, or NULL when closed */
+
+	char *p;
+	ssize_t ret;
+
+	for (;;) {
+
+		if ((p = memchr(server_st.buf, '\n', server_st.len))) {
+
+			static char line[sizeof(server_st.buf)];
+			size_t n = (size_t)(p - server_st.buf) + 1;
+
+			memcpy(line, server_st.buf, n);
+			line[n - 1] = 0;
+
+			if (n > 1 && line[n - 2] == '\r')
+				line[n - 2] = 0;
+
+			memmove(server_st.buf, server_st.buf + n, server_st.len - n);
+			server_st.len -= n;
+
+			return line;
+		}
+
+		if (server_st.len == sizeof(server_st.buf))
+			server_st.len = 0;
+
+		ret = read(server_st.soc, server_st.buf + server_st.len, sizeof(server_st.buf) - server_st.len);
+
+		if (ret == 0)
+			return NULL;
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fatal("read: %s", strerror(errno));
+		}
+
+		server_st.len += (size_t)ret;
+	}
+}
+
+static double
+loopback_now_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		fatal("clock_gettime: %s", strerror(errno));
+
+	return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int
+loopback_send(const char *buf, size_t len)
+{
+	while (len) {
+
+		ssize_t ret;
+
+		if ((ret = write(server_st.soc, buf, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		buf += ret;
+		len -= (size_t)ret;
+	}
+
+	return 0;
+}
+
+static void
+loopback_accept(int soc, void *arg)
+{
+	/* Called from the connecting thread with the server end */
+
+	pthread_t tid;
+
+	UNUSED(arg);
+
+	server_st.soc = soc;
+
+	if ((errno = pthread_create(&tid, NULL, loopback_server, NULL)))
+		fatal("pthread_create: %s", strerror(errno));
+
+	if ((errno = pthread_detach(tid)))
+		fatal("pthread_detach: %s", strerror(errno));
+}
+
+static void
+loopback_traffic(const char *nick)
+{
+	/* Build the burst sent after registration: the client joins
+	 * each channel, then others speak in them round robin */
+
+	static const char *const text[] = {
+		"hi",
+		"did anyone else see the netsplit earlier?",
+		"https://example.com/a/fairly/long/path/to/something?with=query&and=more",
+		"lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+		"tempor incididunt ut labore et dolore magna aliqua. ut enim ad minim veniam, "
+		"quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo",
+		"caf\xc3\xa9 \xe2\x82\xac\xe2\x82\xac \xf0\x9f\x98\x80",
+	};
+
+	char line[512];
+	int len;
+
+	for (unsigned i = 0; i < LOOPBACK_CHANS; i++) {
+		len = snprintf(line, sizeof(line), ":%s!rirc@loopback JOIN #bench%u\r\n", nick, i);
+		loopback_send(line, (size_t)len);
+	}
+
+	for (unsigned long i = 0; i < traffic.n; i++) {
+
+		len = snprintf(line, sizeof(line), ":nick%lu!user@loopback PRIVMSG #bench%lu :%s\r\n",
+			i % LOOPBACK_NICKS,
+			i % LOOPBACK_CHANS,
+			text[i % ARR_LEN(text)]);
+
+		if (traffic.len + (size_t)len > traffic.size) {
+			traffic.size = (traffic.size ? traffic.size * 2 : (1 << 16));
+			if (!(traffic.buf = realloc(traffic.buf, traffic.size)))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		memcpy(traffic.buf + traffic.len, line, (size_t)len);
+		traffic.len += (size_t)len;
+	}
+}
+
+static void
+loopback_tty(void)
+{
+	/* The client requires a terminal on stdin */
+
+	int fd;
+	int tty;
+	char *name;
+	struct winsize ws = {
+		.ws_col = LOOPBACK_COLS,
+		.ws_row = LOOPBACK_ROWS,
+	};
+
+	if ((fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0)
+		fatal("posix_openpt: %s", strerror(errno));
+
+	if (grantpt(fd) < 0 || unlockpt(fd) < 0 || !(name = ptsname(fd)))
+		fatal("ptsname: %s", strerror(errno));
+
+	if ((tty = open(name, O_RDWR | O_NOCTTY)) < 0)
+		fatal("open: %s", strerror(errno));
+
+	if (ioctl(tty, TIOCSWINSZ, &ws) < 0)
+		fatal("ioctl: %s", strerror(errno));
+
+	if (dup2(tty, STDIN_FILENO) < 0)
+		fatal("dup2: %s", strerror(errno));
+
+	close(tty);
+}
+
+static void
+loopback_usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-u] [-n messages]\n"
+		"  -u  Use io_uring\n"
+		"  -n  Number of messages (default: 100000)\n",
+		runtime_name);
+}
+
+static void*
+loopback_server(void *arg)
+{
+	char *line;
+	char nick[64] = "rirc";
+	char buf[256];
+	int len;
+
+	UNUSED(arg);
+
+	/* Registration, CAP is ignored */
+	while ((line = loopback_recv()) && strncmp(line, "USER ", 5)) {
+		if (!strncmp(line, "NICK ", 5))
+			snprintf(nick, sizeof(nick), "%s", line + 5);
+	}
+
+	if (!line)
+		fatal("loopback: closed during registration");
+
+	len = snprintf(buf, sizeof(buf),
+		":loopback 001 %s :Welcome\r\n"
+		":loopback 376 %s :End of MOTD\r\n",
+		nick, nick);
+
+	loopback_send(buf, (size_t)len);
+	loopback_traffic(nick);
+
+	server_st.t0 = loopback_now_us();
+
+	if (loopback_send(traffic.buf, traffic.len)
+	 || loopback_send("PING :" LOOPBACK_TOKEN "\r\n", sizeof("PING :" LOOPBACK_TOKEN "\r\n") - 1))
+		fatal("loopback: closed during traffic");
+
+	while ((line = loopback_recv()) && strcmp(line, "PONG " LOOPBACK_TOKEN))
+		;
+
+	server_st.t1 = loopback_now_us();
+
+	if (!line)
+		fatal("loopback: closed before PONG");
+
+	io_stop();
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	double cpu_us;
+	double wall_us;
+	int opt;
+	int ret;
+	struct rusage ru0;
+	struct rusage ru1;
+	struct server *s;
+
+	traffic.n = 100000;
+
+	while ((opt = getopt(argc, argv, "un:h")) != -1) {
+		switch (opt) {
+			case 'u':
+				io_uring_enabled = 1;
+				break;
+			case 'n':
+				if (!(traffic.n = strtoul(optarg, NULL, 10))) {
+					loopback_usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				loopback_usage();
+				return (opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc) {
+		loopback_usage();
+		return EXIT_FAILURE;
+	}
+
+	loopback_tty();
+
+	if (!freopen("/dev/null", "w", stdout))
+		fatal("freopen: %s", strerror(errno));
+
+	state_init();
+	io_init();
+	io_loopback(loopback_accept, NULL);
+
+	s = server("loopback", "0", NULL, default_username, default_realname);
+	s->connection = connection(s, "loopback", "0", IO_LOOPBACK);
+
+	if (server_list_add(state_server_list(), s))
+		fatal("server_list_add");
+
+	channel_set_current(s->channel);
+
+	if ((ret = io_cx(s->connection)))
+		fatal("io_cx: %s", io_err(ret));
+
+	if (getrusage(RUSAGE_SELF, &ru0) < 0)
+		fatal("getrusage: %s", strerror(errno));
+
+	draw_init();
+	io_start();
+
+	if (getrusage(RUSAGE_SELF, &ru1) < 0)
+		fatal("getrusage: %s", strerror(errno));
+
+	draw_term();
+	state_term();
+
+	wall_us = server_st.t1 - server_st.t0;
+	cpu_us  = LOOPBACK_TV_US(ru1.ru_utime) - LOOPBACK_TV_US(ru0.ru_utime);
+	cpu_us += LOOPBACK_TV_US(ru1.ru_stime) - LOOPBACK_TV_US(ru0.ru_stime);
+
+	fprintf(stderr, "%lu messages, %.3f s\n", traffic.n, wall_us / 1e6);
+
+	if (wall_us > 0) {
+		fprintf(stderr, "%.0f messages/s, %.3f us CPU/message\n",
+			(double)traffic.n / (wall_us / 1e6),
+			cpu_us / (double)traffic.n);
+	}
+
+	free(traffic.buf);
+
+	return EXIT_SUCCESS;
+}
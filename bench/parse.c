@@ -0,0 +1,233 @@
+/* rirc-bench-parse ~ protocol layer throughput
+ *
+ * Lines of a corpus (see bench/parse.txt) are parsed with irc_message_parse
+ * and dispatched with irc_recv to a registered server, as received. Drawing
+ * is sunk to /dev/null and sent lines are discarded, see bench/sink.h.
+ *
+ * Reports messages per second and time per message, for parsing alone and
+ * for parsing and dispatch */
+
+#include "bench/sink.h"
+#include "src/draw.h"
+#include "src/handlers/irc_recv.h"
+#include "src/io.h"
+#include "src/rirc.h"
+#include "src/state.h"
+#include "src/utils/capture.h"
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PARSE_COLS 120
+#define PARSE_ROWS 40
+
+static int parse_load(const char*);
+static uint64_t parse_run(int);
+static void parse_usage(void);
+
+const char *runtime_name = "rirc-bench-parse";
+
+static struct {
+	struct {
+		size_t len;
+		size_t off;
+	} *lines;
+	char *buf;
+	size_t buf_len;
+	size_t buf_size;
+	size_t len_max;
+	size_t n;
+	size_t size;
+} parse;
+
+static int
+parse_load(const char *path)
+{
+	/* Load lines, filtered as received */
+
+	FILE *f;
+	char *line = NULL;
+	char *next;
+	size_t line_size = 0;
+	ssize_t ret;
+
+	if (!(f = fopen(path, "rb"))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while ((ret = getline(&line, &line_size, f)) > 0) {
+
+		size_t len;
+
+		if (line[ret - 1] != '\n')
+			line[ret++] = '\n';
+
+		if (!(next = irc_strline(line, line + ret, &len)) || !len)
+			continue;
+
+		if (parse.n == parse.size) {
+			parse.size = (parse.size ? parse.size * 2 : 1024);
+			if (!(parse.lines = realloc(parse.lines, parse.size * sizeof(*parse.lines))))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		while (parse.buf_len + len > parse.buf_size) {
+			parse.buf_size = (parse.buf_size ? parse.buf_size * 2 : (1 << 16));
+			if (!(parse.buf = realloc(parse.buf, parse.buf_size)))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		parse.lines[parse.n].len = len;
+		parse.lines[parse.n].off = parse.buf_len;
+		parse.len_max = MAX(parse.len_max, len);
+		parse.n++;
+
+		memcpy(parse.buf + parse.buf_len, line, len);
+		parse.buf_len += len;
+	}
+
+	free(line);
+
+	if (ferror(f)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+
+	return 0;
+}
+
+static uint64_t
+parse_run(int dispatch)
+{
+	/* Parse, and optionally dispatch, each line from a copy
+	 * as parsing is in place. Returns elapsed nanoseconds */
+
+	char *line;
+	struct server *s;
+	uint64_t t0;
+	uint64_t t1;
+
+	if (!(line = malloc(parse.len_max + 1)))
+		fatal("malloc: %s", strerror(errno));
+
+	s = server("bench", "6667", NULL, default_username, default_realname);
+
+	if (server_set_nicks(s, "rirc"))
+		fatal("server_set_nicks");
+
+	if (server_list_add(state_server_list(), s))
+		fatal("server_list_add");
+
+	channel_set_current(s->channel);
+
+	io_cb_cxed(s);
+
+	t0 = capture_ns();
+
+	for (size_t i = 0; i < parse.n; i++) {
+
+		struct irc_message m;
+
+		memcpy(line, parse.buf + parse.lines[i].off, parse.lines[i].len);
+		line[parse.lines[i].len] = 0;
+
+		if (irc_message_parse(&m, line) == 0 && dispatch)
+			irc_recv(s, &m);
+	}
+
+	t1 = capture_ns();
+
+	free(line);
+
+	return (t1 - t0);
+}
+
+static void
+parse_usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-n passes] corpus\n"
+		"  -n  Number of passes (default: 100)\n",
+		runtime_name);
+}
+
+int
+main(int argc, char **argv)
+{
+	double parse_ns = 0;
+	double recv_ns = 0;
+	int opt;
+	unsigned long passes = 100;
+	unsigned long messages;
+
+	while ((opt = getopt(argc, argv, "n:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				if (!(passes = strtoul(optarg, NULL, 10))) {
+					parse_usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				parse_usage();
+				return (opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		parse_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (parse_load(argv[optind]))
+		return EXIT_FAILURE;
+
+	if (!freopen("/dev/null", "w", stdout))
+		fatal("freopen: %s", strerror(errno));
+
+	for (unsigned long i = 0; i < passes; i++) {
+
+		state_init();
+		draw_init();
+		io_cb_sigwinch(PARSE_COLS, PARSE_ROWS);
+
+		parse_ns += (double)parse_run(0);
+
+		draw_term();
+		state_term();
+
+		state_init();
+		draw_init();
+		io_cb_sigwinch(PARSE_COLS, PARSE_ROWS);
+
+		recv_ns += (double)parse_run(1);
+
+		draw_term();
+		state_term();
+	}
+
+	messages = passes * parse.n;
+
+	fprintf(stderr, "%lu messages, %lu sent\n", messages, sink_sent);
+
+	if (messages && parse_ns > 0 && recv_ns > 0) {
+		fprintf(stderr, "parse:          %10.0f messages/s, %8.1f ns/message\n",
+			(double)messages / (parse_ns / 1e9),
+			parse_ns / (double)messages);
+		fprintf(stderr, "parse+dispatch: %10.0f messages/s, %8.1f ns/message\n",
+			(double)messages / (recv_ns / 1e9),
+			recv_ns / (double)messages);
+	}
+
+	free(parse.lines);
+	free(parse.buf);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/* rirc-replay ~ replay a traffic capture through the client
+ *
+ * Received lines of a capture (see src/utils/capture.h) are framed as
+ * a connection would frame them and passed to io_cb_read_soc, either as
+ * fast as possible or at their recorded speed. Drawing is sunk to
+ * /dev/null and sent lines are discarded, see bench/sink.h.
+ *
+ * Reports messages per second and CPU time per message */
+
+#include "bench/sink.h"
+#include "src/draw.h"
+#include "src/io.h"
+#include "src/rirc.h"
+#include "src/state.h"
+#include "src/utils/capture.h"
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Maximum bytes framed per callback, as a connection receive slot */
+#define REPLAY_CHUNK (1 << 14)
+
+#define REPLAY_COLS 120
+#define REPLAY_ROWS 40
+
+#define REPLAY_TV_US(TV) ((double)(TV).tv_sec * 1e6 + (double)(TV).tv_usec)
+
+static int replay_load(const char*);
+static void replay_run(int);
+static void replay_usage(void);
+
+const char *runtime_name = "rirc-replay";
+
+static struct {
+	struct {
+		uint64_t ns;
+		size_t len;
+		size_t off;
+	} *recs;
+	char *buf;
+	size_t buf_len;
+	size_t buf_size;
+	size_t n;
+	size_t size;
+} replay;
+
+static int
+replay_load(const char *path)
+{
+	/* Load received lines, terminated by "\r\n" */
+
+	FILE *f;
+	int ret;
+	static char line[CAPTURE_LINE_MAX + 1];
+	struct capture_rec rec = { .line = line };
+
+	if (!(f = fopen(path, "rb"))) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	if (capture_header_read(f)) {
+		fprintf(stderr, "%s: invalid capture header\n", path);
+		fclose(f);
+		return -1;
+	}
+
+	while ((ret = capture_read(f, &rec)) == 1) {
+
+		if (rec.dir != CAPTURE_RECV || rec.len + 2 > REPLAY_CHUNK)
+			continue;
+
+		if (replay.n == replay.size) {
+			replay.size = (replay.size ? replay.size * 2 : 1024);
+			if (!(replay.recs = realloc(replay.recs, replay.size * sizeof(*replay.recs))))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		while (replay.buf_len + rec.len + 2 > replay.buf_size) {
+			replay.buf_size = (replay.buf_size ? replay.buf_size * 2 : (1 << 16));
+			if (!(replay.buf = realloc(replay.buf, replay.buf_size)))
+				fatal("realloc: %s", strerror(errno));
+		}
+
+		replay.recs[replay.n].ns = rec.ns;
+		replay.recs[replay.n].len = rec.len + 2;
+		replay.recs[replay.n].off = replay.buf_len;
+		replay.n++;
+
+		memcpy(replay.buf + replay.buf_len, rec.line, rec.len);
+		replay.buf_len += rec.len;
+		replay.buf[replay.buf_len++] = '\r';
+		replay.buf[replay.buf_len++] = '\n';
+	}
+
+	fclose(f);
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: invalid capture record\n", path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+replay_run(int recorded)
+{
+	/* Frame consecutive lines into chunks as received, at recorded
+	 * speed only lines received at the same time are framed together */
+
+	char chunk[REPLAY_CHUNK];
+	size_t i = 0;
+	struct server *s;
+	uint64_t t0 = capture_ns();
+
+	s = server("replay", "6667", NULL, default_username, default_realname);
+
+	if (server_list_add(state_server_list(), s))
+		fatal("server_list_add");
+
+	channel_set_current(s->channel);
+
+	io_cb_cxed(s);
+
+	while (i < replay.n) {
+
+		size_t len = 0;
+
+		if (recorded) {
+
+			uint64_t t = t0 + (replay.recs[i].ns - replay.recs[0].ns);
+			uint64_t t_now;
+
+			while ((t_now = capture_ns()) < t) {
+
+				struct timespec ts = {
+					.tv_sec  = (time_t)((t - t_now) / 1000000000),
+					.tv_nsec = (long)((t - t_now) % 1000000000),
+				};
+
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		do {
+			memcpy(chunk + len, replay.buf + replay.recs[i].off, replay.recs[i].len);
+			len += replay.recs[i].len;
+			i++;
+		} while (i < replay.n
+		      && len + replay.recs[i].len <= sizeof(chunk)
+		      && (!recorded || replay.recs[i].ns == replay.recs[i - 1].ns));
+
+		io_cb_read_soc(chunk, len, s);
+	}
+}
+
+static void
+replay_usage(void)
+{
+	fprintf(stderr,
+		"Usage: %s [-r] [-n passes] capture\n"
+		"  -r  Replay at recorded speed\n"
+		"  -n  Number of passes (default: 1)\n",
+		runtime_name);
+}
+
+int
+main(int argc, char **argv)
+{
+	double cpu_us = 0;
+	double wall_us = 0;
+	int opt;
+	int recorded = 0;
+	unsigned long passes = 1;
+	unsigned long messages;
+
+	while ((opt = getopt(argc, argv, "rn:h")) != -1) {
+		switch (opt) {
+			case 'r':
+				recorded = 1;
+				break;
+			case 'n':
+				if (!(passes = strtoul(optarg, NULL, 10))) {
+					replay_usage();
+					return EXIT_FAILURE;
+				}
+				break;
+			default:
+				replay_usage();
+				return (opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		replay_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (replay_load(argv[optind]))
+		return EXIT_FAILURE;
+
+	if (!freopen("/dev/null", "w", stdout))
+		fatal("freopen: %s", strerror(errno));
+
+	for (unsigned long i = 0; i < passes; i++) {
+
+		struct rusage ru0;
+		struct rusage ru1;
+		uint64_t t0;
+		uint64_t t1;
+
+		state_init();
+		draw_init();
+		io_cb_sigwinch(REPLAY_COLS, REPLAY_ROWS);
+
+		if (getrusage(RUSAGE_SELF, &ru0) < 0)
+			fatal("getrusage: %s", strerror(errno));
+
+		t0 = capture_ns();
+
+		replay_run(recorded);
+
+		t1 = capture_ns();
+
+		if (getrusage(RUSAGE_SELF, &ru1) < 0)
+			fatal("getrusage: %s", strerror(errno));
+
+		wall_us += (double)(t1 - t0) / 1e3;
+		cpu_us += REPLAY_TV_US(ru1.ru_utime) - REPLAY_TV_US(ru0.ru_utime);
+		cpu_us += REPLAY_TV_US(ru1.ru_stime) - REPLAY_TV_US(ru0.ru_stime);
+
+		draw_term();
+		state_term();
+	}
+
+	messages = passes * replay.n;
+
+	fprintf(stderr, "%lu messages, %lu sent, %.3f s\n", messages, sink_sent, wall_us / 1e6);
+
+	if (messages && wall_us > 0) {
+		fprintf(stderr, "%.0f messages/s, %.3f us CPU/message\n",
+			(double)messages / (wall_us / 1e6),
+			cpu_us / (double)messages);
+	}
+
+	free(replay.recs);
+	free(replay.buf);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+#include "bench/sink.h"
+
+#include "src/io.h"
+#include "src/rirc.h"
+#include "src/utils/utils.h"
+
+const char *ca_cert_path;
+const char *capture_dir;
+const char *default_username = "rirc";
+const char *default_realname = "rirc";
+int io_uring_enabled;
+
+unsigned long sink_sent;
+
+struct connection*
+connection(const void *obj, const char *host, const char *port, uint32_t flags)
+{
+	UNUSED(obj);
+	UNUSED(host);
+	UNUSED(port);
+	UNUSED(flags);
+
+	return NULL;
+}
+
+void
+connection_free(struct connection *cx)
+{
+	UNUSED(cx);
+}
+
+int
+io_cx(struct connection *cx)
+{
+	UNUSED(cx);
+
+	return 0;
+}
+
+int
+io_dx(struct connection *cx)
+{
+	UNUSED(cx);
+
+	return 0;
+}
+
+int
+io_sendf(struct connection *cx, const char *fmt, ...)
+{
+	UNUSED(cx);
+	UNUSED(fmt);
+
+	sink_sent++;
+
+	return 0;
+}
+
+const char*
+io_err(int err)
+{
+	UNUSED(err);
+
+	return "sink";
+}
+
+void
+io_stop(void)
+{
+	;
+}
@@ -0,0 +1,10 @@
+#ifndef RIRC_BENCH_SINK_H
+#define RIRC_BENCH_SINK_H
+
+/* Connection sink for benchmarks, in place of io.c
+ *
+ * Connections are never opened, sent lines are counted and discarded */
+
+extern unsigned long sink_sent;
+
+#endif
@@ -9,6 +9,12 @@
  */
 #define DEFAULT_NICKS ""
 
+/* Comma separated set of words highlighting messages, in addition to nicks
+ *   String
+ *   ("": none)
+ */
+#define HIGHLIGHT_WORDS ""
+
 /* Default Username and Realname sent during connection
  *   String
  *   ("": defaults to effective user id name)
@@ -110,7 +116,7 @@
 
 /* [NETWORK] */
 
-/* Default CA certifate file path
+/* Default CA certifate file path, loaded on first verified TLS connection
  *   ("": a list of known paths is checked) */
 #define CA_CERT_PATH ""
 
@@ -129,6 +135,21 @@
  *   (0: no ping timeout reconnect) */
 #define IO_PING_MAX 300
 
+/* Seconds between latency probes
+ *   Integer, [0, 30, 86400]
+ *   (0: no latency probes) */
+#define IO_PROBE_INTERVAL 30
+
+/* Offload TLS 1.2 record encryption to the kernel after the handshake,
+ * falling back to userspace TLS when unsupported (Linux only)
+ *   Integer, [0, 0, 1] */
+#define IO_TLS_KTLS 0
+
+/* Use io_uring for terminal input and batched socket writes, falling
+ * back to poll when unsupported (Linux only), see also --io-uring
+ *   Integer, [0, 0, 1] */
+#define IO_URING 0
+
 /* Reconnect backoff base delay
  *   Integer, [1, 4, 86400] */
 #define IO_RECONNECT_BACKOFF_BASE 4
@@ -140,3 +161,25 @@
 /* Reconnect backoff maximum
  *   Integer, [1, 86400, 86400] */
 #define IO_RECONNECT_BACKOFF_MAX 86400
+
+/* Maximum concurrent connection attempts across all servers
+ *   Integer, [1, 4, 1024] */
+#define IO_CONNECT_MAX 4
+
+/* Disable Nagle's algorithm on TCP connections, see also --tcp-nodelay
+ *   Integer, [0, 1, 1] */
+#define IO_TCP_NODELAY 1
+
+/* TCP keepalive seconds idle before probing, seconds between probes, and
+ * unanswered probes before dropping the connection, see also --tcp-keepalive
+ *   Integer, [0, 60, 86400], [1, 10, 86400], [1, 3, 127]
+ *   (IO_TCP_KEEPALIVE_IDLE 0: no keepalive) */
+#define IO_TCP_KEEPALIVE_IDLE  60
+#define IO_TCP_KEEPALIVE_INTVL 10
+#define IO_TCP_KEEPALIVE_CNT   3
+
+/* Seconds sent data may remain unacknowledged before dropping the
+ * connection (Linux only), see also --tcp-user-timeout
+ *   Integer, [0, 90, 86400]
+ *   (0: system default) */
+#define IO_TCP_USER_TIMEOUT 90
@@ -100,7 +100,20 @@
 
 /* TLS extensions */
 #define MBEDTLS_SSL_EXTENDED_MASTER_SECRET /* RFC 7627 */
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH    /* RFC 6066 */
 #define MBEDTLS_SSL_SERVER_NAME_INDICATION /* RFC 6066 */
+#define MBEDTLS_SSL_SESSION_TICKETS        /* RFC 5077 */
+
+/* Record buffers
+ *   - Outgoing records are lines of at most 512 bytes, and the
+ *     client handshake messages, without client certificates
+ *   - Incoming records remain the maximum length for servers
+ *     declining the max_fragment_length extension, buffers are
+ *     reduced to the negotiated length after the handshake
+ */
+#define MBEDTLS_SSL_IN_CONTENT_LEN  16384
+#define MBEDTLS_SSL_OUT_CONTENT_LEN 4096
+#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
 
 /* Crypto features */
 #define MBEDTLS_ECDSA_DETERMINISTIC
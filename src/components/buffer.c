@@ -3,10 +3,15 @@
 #include "config.h"
 #include "src/utils/utils.h"
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define BUFFER_MASK(X) ((X) & (BUFFER_LINES_MAX - 1))
 
+/* Line text allocation granularity, power of 2 */
+#define BUFFER_TEXT_ALIGN 64
+
 #if BUFFER_MASK(BUFFER_LINES_MAX)
 /* Required for proper masking when indexing */
 #error BUFFER_LINES_MAX must be a power of 2
@@ -134,6 +139,9 @@ buffer_newline(
 		char prefix)
 {
 	struct buffer_line *line;
+	char *text;
+	size_t text_size;
+	size_t size;
 
 	if (from_str == NULL)
 		fatal("from string is NULL");
@@ -141,10 +149,26 @@ buffer_newline(
 	if (text_str == NULL)
 		fatal("text string is NULL");
 
-	line = memset(buffer_push(b), 0, sizeof(*line));
+	line = buffer_push(b);
+
+	/* Reuse the overwritten line's text if it fits without excess */
+	text = line->text;
+	text_size = line->text_size;
+	text_len = MIN(text_len, TEXT_LENGTH_MAX);
+	size = (text_len + BUFFER_TEXT_ALIGN) & ~((size_t)BUFFER_TEXT_ALIGN - 1);
+
+	if (text_size < text_len + 1 || text_size > size * 2) {
+		if ((text = realloc(text, size)) == NULL)
+			fatal("realloc: %s", strerror(errno));
+		text_size = size;
+	}
 
+	line = memset(line, 0, sizeof(*line));
+
+	line->text = text;
+	line->text_size = text_size;
 	line->from_len = MIN(from_len + (!!prefix), FROM_LENGTH_MAX);
-	line->text_len = MIN(text_len,              TEXT_LENGTH_MAX);
+	line->text_len = text_len;
 
 	if (prefix)
 		*line->from = prefix;
@@ -160,16 +184,6 @@ buffer_newline(
 
 	if (line->from_len > b->pad)
 		b->pad = line->from_len;
-
-	if (text_len > TEXT_LENGTH_MAX) {
-		buffer_newline(b,
-				type,
-				from_str,
-				text_str + TEXT_LENGTH_MAX,
-				from_len,
-				text_len - TEXT_LENGTH_MAX,
-				prefix);
-	}
 }
 
 unsigned
@@ -191,6 +205,15 @@ buffer(struct buffer *b)
 	memset(b, 0, sizeof(*b));
 }
 
+void
+buffer_free(struct buffer *b)
+{
+	for (size_t i = 0; i < BUFFER_LINES_MAX; i++)
+		free(b->buffer_lines[i].text);
+
+	memset(b, 0, sizeof(*b));
+}
+
 void
 buffer_line_split(
 	struct buffer_line *line,
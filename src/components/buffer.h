@@ -3,7 +3,9 @@
 
 #include <time.h>
 
-#define TEXT_LENGTH_MAX 510 /* FIXME: remove max lengths in favour of growable buffer */
+/* IRCv3 message-tags, 8191 bytes of tags and 512 bytes of message.
+ * Line text is allocated per line, text beyond this length is truncated */
+#define TEXT_LENGTH_MAX (8191 + 512)
 #define FROM_LENGTH_MAX 100
 
 #ifndef BUFFER_LINES_MAX
@@ -30,9 +32,10 @@ struct buffer_line
 	enum buffer_line_type type;
 	char prefix; /* TODO as part of `from` */
 	char from[FROM_LENGTH_MAX + 1]; /* TODO: from/text as struct string */
-	char text[TEXT_LENGTH_MAX + 1];
+	char *text;
 	size_t from_len;
 	size_t text_len;
+	size_t text_size; /* Allocated, reused when the line is overwritten */
 	time_t time;
 	struct {
 		unsigned colour; /* Cached colour of `from` text */
@@ -59,6 +62,7 @@ int buffer_page_forw(struct buffer*, unsigned, unsigned);
 unsigned buffer_line_rows(struct buffer_line*, unsigned);
 
 void buffer(struct buffer*);
+void buffer_free(struct buffer*);
 
 struct buffer_line* buffer_head(struct buffer*);
 struct buffer_line* buffer_tail(struct buffer*);
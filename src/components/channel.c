@@ -30,6 +30,7 @@ channel(const char *name, enum channel_type type)
 void
 channel_free(struct channel *c)
 {
+	buffer_free(&c->buffer);
 	input_free(&c->input);
 	user_list_free(&(c->users));
 	free(c);
@@ -113,7 +114,6 @@ void
 channel_part(struct channel *c)
 {
 	channel_reset(c);
-	c->joined = 0;
 	c->parted = 1;
 }
 
@@ -122,4 +122,5 @@ channel_reset(struct channel *c)
 {
 	mode_reset(&(c->chanmodes), &(c->chanmodes_str));
 	user_list_free(&(c->users));
+	c->joined = 0;
 }
@@ -1,5 +1,9 @@
 #include "src/components/ircv3.h"
 
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 struct ircv3_cap*
@@ -38,3 +42,68 @@ ircv3_caps_reset(struct ircv3_caps *caps)
 	IRCV3_CAPS
 	#undef X
 }
+
+struct ircv3_batch*
+ircv3_batch(const char *ref, const char *type, const char *params)
+{
+	struct ircv3_batch *b;
+
+	if ((b = calloc(1, sizeof(*b))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	b->ref = strdup(ref);
+	b->type = strdup(type);
+	b->params = strdup(params ? params : "");
+
+	return b;
+}
+
+struct ircv3_batch*
+ircv3_batch_get(struct ircv3_batch *b, const char *ref)
+{
+	for (; b; b = b->next) {
+		if (!strcmp(b->ref, ref))
+			return b;
+	}
+
+	return NULL;
+}
+
+int
+ircv3_batch_line(struct ircv3_batch *b, const char *line, size_t len)
+{
+	/* Buffer a received line, returns -1 if the batch is full */
+
+	if (b->len + len + 1 > IRCV3_BATCH_SIZE_MAX)
+		return -1;
+
+	if (b->len + len + 1 > b->size) {
+
+		size_t size = (b->size ? b->size : 4096);
+
+		while (size < b->len + len + 1)
+			size *= 2;
+
+		if ((b->lines = realloc(b->lines, size)) == NULL)
+			fatal("realloc: %s", strerror(errno));
+
+		b->size = size;
+	}
+
+	memcpy(b->lines + b->len, line, len);
+	b->len += len;
+	b->lines[b->len++] = 0;
+	b->count++;
+
+	return 0;
+}
+
+void
+ircv3_batch_free(struct ircv3_batch *b)
+{
+	free(b->ref);
+	free(b->type);
+	free(b->params);
+	free(b->lines);
+	free(b);
+}
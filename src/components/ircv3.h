@@ -1,6 +1,8 @@
 #ifndef RIRC_COMPONENTS_IRCV3_CAP_H
 #define RIRC_COMPONENTS_IRCV3_CAP_H
 
+#include <stddef.h>
+
 #define IRCV3_CAP_AUTO   (1 << 0)
 #define IRCV3_CAP_NO_DEL (1 << 1)
 #define IRCV3_CAP_NO_REQ (1 << 2)
@@ -10,6 +12,7 @@
 #define IRCV3_CAPS_DEF \
 	X("account-notify", account_notify, IRCV3_CAP_AUTO) \
 	X("away-notify",    away_notify,    IRCV3_CAP_AUTO) \
+	X("batch",          batch,          IRCV3_CAP_AUTO) \
 	X("chghost",        chghost,        IRCV3_CAP_AUTO) \
 	X("extended-join",  extended_join,  IRCV3_CAP_AUTO) \
 	X("invite-notify",  invite_notify,  IRCV3_CAP_AUTO) \
@@ -42,9 +45,31 @@ struct ircv3_caps
 	#undef X
 };
 
+/* Bytes of received lines buffered per batch, further lines
+ * are handled as received */
+#define IRCV3_BATCH_SIZE_MAX (1 << 20)
+
+struct ircv3_batch
+{
+	struct ircv3_batch *next;
+	struct ircv3_batch *parent; /* nested, lines are buffered by the parent */
+	char *ref;
+	char *type;
+	char *params; /* type parameters, as received, or "" */
+	char *lines;  /* received lines, each null terminated */
+	size_t len;
+	size_t size;
+	unsigned count;
+};
+
 struct ircv3_cap* ircv3_cap_get(struct ircv3_caps*, const char*);
 
 void ircv3_caps(struct ircv3_caps*);
 void ircv3_caps_reset(struct ircv3_caps*);
 
+struct ircv3_batch* ircv3_batch(const char*, const char*, const char*);
+struct ircv3_batch* ircv3_batch_get(struct ircv3_batch*, const char*);
+int ircv3_batch_line(struct ircv3_batch*, const char*, size_t);
+void ircv3_batch_free(struct ircv3_batch*);
+
 #endif
@@ -1,5 +1,6 @@
 #include "src/components/server.h"
 
+#include "config.h"
 #include "src/state.h"
 #include "src/utils/utils.h"
 
@@ -7,6 +8,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define HANDLED_005 \
 	X(CASEMAPPING)  \
@@ -21,7 +23,12 @@ struct opt
 };
 
 static int parse_005(struct opt*, char**);
+static void server_highlight(struct server*);
+static void server_isupport_del(struct server*, const char*);
+static void server_isupport_set(struct server*, const char*, const char*);
 static int server_cmp(const struct server*, const char*, const char*);
+static unsigned long long server_lag_now(void);
+static unsigned server_lag_bucket(unsigned);
 
 #define X(cmd) static int server_set_##cmd(struct server*, char*);
 HANDLED_005
@@ -49,6 +56,8 @@ server(const char *host, const char *port, const char *pass, const char *user, c
 	s->channel->server = s;
 	channel_list_add(&(s->clist), s->channel);
 
+	server_highlight(s);
+
 	return s;
 }
 
@@ -131,15 +140,98 @@ server_reset(struct server *s)
 {
 	ircv3_caps_reset(&(s->ircv3_caps));
 	mode_reset(&(s->usermodes), &(s->mode_str));
+
+	while (s->batches) {
+		struct ircv3_batch *b = s->batches;
+		s->batches = b->next;
+		ircv3_batch_free(b);
+	}
+
+	for (size_t i = 0; i < s->isupport.n; i++) {
+		free(s->isupport.opts[i].arg);
+		free(s->isupport.opts[i].val);
+	}
+
+	s->isupport.n = 0;
+
+	memset(&(s->lag), 0, sizeof(s->lag));
+	s->autojoin = 0;
 	s->ping = 0;
 	s->quitting = 0;
 	s->registered = 0;
 	s->nicks.next = 0;
 }
 
+const char*
+server_lag_probe(struct server *s)
+{
+	/* Begin a latency probe, returns the token to be echoed by PONG
+	 *
+	 * A probe still unanswered when replaced is recorded with the time
+	 * elapsed so far, a lower bound of its round trip, such that lag
+	 * exceeding the probe interval is reflected in the histogram */
+
+	static unsigned token;
+
+	if (*s->lag.token)
+		server_lag_add(s, (unsigned) MIN(server_lag_now() - s->lag.sent, (unsigned long long)(-1U)));
+
+	(void) snprintf(s->lag.token, sizeof(s->lag.token), "rirc.%u", ++token);
+
+	s->lag.sent = server_lag_now();
+
+	return s->lag.token;
+}
+
+int
+server_lag_pong(struct server *s, const char *token)
+{
+	/* Complete an outstanding latency probe matching token */
+
+	if (!*s->lag.token || strcmp(s->lag.token, token))
+		return -1;
+
+	*s->lag.token = 0;
+
+	server_lag_add(s, (unsigned) MIN(server_lag_now() - s->lag.sent, (unsigned long long)(-1U)));
+
+	return 0;
+}
+
+void
+server_lag_add(struct server *s, unsigned ms)
+{
+	s->lag.hist[server_lag_bucket(ms)]++;
+	s->lag.count++;
+	s->lag.last = ms;
+}
+
+unsigned
+server_lag_pct(const struct server *s, unsigned pct)
+{
+	/* Upper bound of the bucket containing the pct percentile sample */
+
+	unsigned long long n = 0;
+	unsigned long long rank;
+
+	if (!s->lag.count)
+		return 0;
+
+	rank = ((unsigned long long)s->lag.count * MIN(pct, 100) + 99) / 100;
+
+	for (unsigned i = 0; i < SERVER_LAG_BUCKETS; i++) {
+		if ((n += s->lag.hist[i]) >= MAX(rank, 1))
+			return server_lag_bucket_max(i);
+	}
+
+	return server_lag_bucket_max(SERVER_LAG_BUCKETS - 1);
+}
+
 void
 server_free(struct server *s)
 {
+	server_reset(s);
+
 	channel_list_free(&(s->clist));
 
 	user_list_free(&(s->ignore));
@@ -152,6 +244,8 @@ server_free(struct server *s)
 	free((void *)s->nick);
 	free((void *)s->nicks.base);
 	free((void *)s->nicks.set);
+	free(s->isupport.opts);
+	highlight_free(&(s->highlight));
 	free(s);
 }
 
@@ -243,6 +337,8 @@ server_set_nicks(struct server *s, const char *str)
 		dup = strchr(dup, 0) + 1;
 	}
 
+	server_highlight(s);
+
 	return 0;
 }
 
@@ -294,6 +390,13 @@ server_set_005(struct server *s, char *str)
 
 		int (*server_set)(struct server*, char*) = NULL;
 
+		if (*opt.arg == '-') {
+			server_isupport_del(s, opt.arg + 1);
+			continue;
+		}
+
+		server_isupport_set(s, opt.arg, opt.val);
+
 		#define X(cmd) \
 		if (!strcmp(opt.arg, #cmd)) \
 			server_set = server_set_##cmd;
@@ -326,6 +429,120 @@ server_cmp(const struct server *s, const char *host, const char *port)
 	return 0;
 }
 
+static unsigned long long
+server_lag_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		fatal("clock_gettime: %s", strerror(errno));
+
+	return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+}
+
+static unsigned
+server_lag_bucket(unsigned ms)
+{
+	/* Values [0, 8) have exact buckets, larger values have four
+	 * buckets per power of 2, i.e. at most 25% relative error */
+
+	unsigned e = 0;
+
+	if (ms < 8)
+		return ms;
+
+	for (unsigned v = ms; v >>= 1;)
+		e++;
+
+	return MIN(8 + (e - 3) * 4 + ((ms >> (e - 2)) & 3), SERVER_LAG_BUCKETS - 1);
+}
+
+unsigned
+server_lag_bucket_max(unsigned b)
+{
+	/* Largest value counted in bucket b */
+
+	unsigned e;
+
+	if (b < 7)
+		return b;
+
+	if (b == SERVER_LAG_BUCKETS - 1)
+		return -1U;
+
+	b++;
+	e = (b - 8) / 4 + 3;
+
+	return ((4 + (b - 8) % 4) << (e - 2)) - 1;
+}
+
+static void
+server_highlight(struct server *s)
+{
+	/* Compile the words highlighting messages: the current nick,
+	 * the configured nicks and HIGHLIGHT_WORDS */
+
+	char *dup;
+	char *p;
+	const char **words;
+	size_t n = 0;
+	size_t size = s->nicks.size + 2;
+
+	for (p = dup = strdup(HIGHLIGHT_WORDS); *p; p++)
+		size += (*p == ',');
+
+	if ((words = malloc(sizeof(*words) * size)) == NULL)
+		fatal("malloc: %s", strerror(errno));
+
+	if (s->nick)
+		words[n++] = s->nick;
+
+	for (size_t i = 0; i < s->nicks.size; i++)
+		words[n++] = s->nicks.set[i];
+
+	for (p = dup; p; ) {
+		words[n++] = p;
+		if ((p = strchr(p, ',')))
+			*p++ = 0;
+	}
+
+	highlight_set(&(s->highlight), s->casemapping, words, n);
+
+	free(words);
+	free(dup);
+}
+
+static void
+server_isupport_del(struct server *s, const char *arg)
+{
+	for (size_t i = 0; i < s->isupport.n; i++) {
+		if (!strcmp(s->isupport.opts[i].arg, arg)) {
+			free(s->isupport.opts[i].arg);
+			free(s->isupport.opts[i].val);
+			s->isupport.opts[i] = s->isupport.opts[--s->isupport.n];
+			return;
+		}
+	}
+}
+
+static void
+server_isupport_set(struct server *s, const char *arg, const char *val)
+{
+	/* Set a numeric 005 token, replacing any previous value */
+
+	server_isupport_del(s, arg);
+
+	if (s->isupport.n == s->isupport.size) {
+		s->isupport.size = (s->isupport.size ? s->isupport.size * 2 : 32);
+		if (!(s->isupport.opts = realloc(s->isupport.opts, s->isupport.size * sizeof(*s->isupport.opts))))
+			fatal("realloc: %s", strerror(errno));
+	}
+
+	s->isupport.opts[s->isupport.n].arg = strdup(arg);
+	s->isupport.opts[s->isupport.n].val = strdup(val ? val : "");
+	s->isupport.n++;
+}
+
 static int
 parse_005(struct opt *opt, char **str)
 {
@@ -345,7 +562,8 @@ parse_005(struct opt *opt, char **str)
 
 	/* FIXME: (see docs)
 	 *
-	 * '-PARAMETER' is valid and negates a previously set parameter to its default
+	 * '-PARAMETER' is valid and negates a previously set parameter to its default,
+	 * handled parameters are removed from the table but not reset
 	 * 'PARAMETER', 'PARAMTER=' are equivalent
 	 *
 	 * The parameter's value may contain sequences of the form "\xHH", where
@@ -374,7 +592,7 @@ parse_005(struct opt *opt, char **str)
 	if (!irc_strtrim(&p))
 		return 0;
 
-	if (!isalnum(*p))
+	if (!isalnum(*p) && !(*p == '-' && isalnum(p[1])))
 		return 0;
 
 	opt->arg = p;
@@ -401,16 +619,19 @@ server_set_CASEMAPPING(struct server *s, char *val)
 {
 	if (!strcmp(val, "ascii")) {
 		s->casemapping = CASEMAPPING_ASCII;
+		server_highlight(s);
 		return 0;
 	}
 
 	if (!strcmp(val, "rfc1459")) {
 		s->casemapping = CASEMAPPING_RFC1459;
+		server_highlight(s);
 		return 0;
 	}
 
 	if (!strcmp(val, "strict-rfc1459")) {
 		s->casemapping = CASEMAPPING_STRICT_RFC1459;
+		server_highlight(s);
 		return 0;
 	}
 
@@ -435,6 +656,52 @@ server_set_PREFIX(struct server *s, char *val)
 	return mode_cfg(&(s->mode_cfg), val, MODE_CFG_PREFIX) != MODE_ERR_NONE;
 }
 
+const char*
+server_isupport(const struct server *s, const char *arg)
+{
+	for (size_t i = 0; i < s->isupport.n; i++) {
+		if (!strcmp(s->isupport.opts[i].arg, arg))
+			return s->isupport.opts[i].val;
+	}
+
+	return NULL;
+}
+
+unsigned
+server_targmax(const struct server *s, const char *command)
+{
+	/* TARGMAX=[cmd:[limit]{,cmd:[limit]}], commands listed without
+	 * a limit are unlimited.
+	 *
+	 * Otherwise JOIN and PART are unlimited, PRIVMSG and NOTICE are
+	 * limited by MAXTARGETS if advertised, and other commands accept
+	 * a single target */
+
+	const char *p;
+	size_t len = strlen(command);
+
+	if ((p = server_isupport(s, "TARGMAX"))) {
+		while (*p) {
+
+			if (!strncmp(p, command, len) && p[len] == ':')
+				return (unsigned) strtoul(p + len + 1, NULL, 10);
+
+			p += strcspn(p, ",");
+			p += (*p == ',');
+		}
+	}
+
+	if (!strcmp(command, "JOIN") || !strcmp(command, "PART"))
+		return 0;
+
+	if (!strcmp(command, "PRIVMSG") || !strcmp(command, "NOTICE")) {
+		if ((p = server_isupport(s, "MAXTARGETS")))
+			return (unsigned) strtoul(p, NULL, 10);
+	}
+
+	return 1;
+}
+
 void
 server_nick_set(struct server *s, const char *nick)
 {
@@ -444,6 +711,8 @@ server_nick_set(struct server *s, const char *nick)
 		free((void *)s->nick);
 
 	s->nick = strdup(nick);
+
+	server_highlight(s);
 }
 
 void
@@ -5,9 +5,10 @@
 #include "src/components/channel.h"
 #include "src/components/ircv3.h"
 #include "src/components/mode.h"
+#include "src/utils/highlight.h"
 
-// TODO: move this to utils
-#define IRC_MESSAGE_LEN 510
+/* Latency histogram buckets, log-linear in milliseconds */
+#define SERVER_LAG_BUCKETS 64
 
 struct server
 {
@@ -18,6 +19,7 @@ struct server
 	const char *realname;
 	const char *nick;
 	enum casemapping casemapping;
+	enum charset charset;
 	struct {
 		size_t next;
 		size_t size;
@@ -26,24 +28,36 @@ struct server
 	} nicks;
 	struct channel *channel;
 	struct channel_list clist;
+	struct highlight highlight; /* nick, nicks and HIGHLIGHT_WORDS */
 	struct ircv3_caps ircv3_caps;
+	struct ircv3_batch *batches; /* open batches */
+	struct {
+		struct {
+			char *arg;
+			char *val;
+		} *opts;
+		size_t n;
+		size_t size;
+	} isupport; /* numeric 005 tokens, as advertised */
 	struct mode usermodes;
 	struct mode_str mode_str;
 	struct mode_cfg mode_cfg;
 	struct server *next;
 	struct server *prev;
 	struct user_list ignore;
+	struct {
+		char token[16];           /* outstanding probe token, "": none */
+		unsigned long long sent;  /* probe send time, milliseconds */
+		unsigned count;           /* samples */
+		unsigned last;            /* last round-trip time, milliseconds */
+		unsigned hist[SERVER_LAG_BUCKETS];
+	} lag;
 	unsigned ping;
+	unsigned autojoin   : 1; /* registered, channels not yet joined */
 	unsigned connected  : 1;
 	unsigned quitting   : 1;
 	unsigned registered : 1;
 	void *connection;
-	// TODO: move this to utils
-	struct {
-		size_t i;
-		char cl;
-		char buf[IRC_MESSAGE_LEN + 1]; /* callback message buffer */
-	} read;
 };
 
 struct server_list
@@ -69,9 +83,22 @@ int server_set_nicks(struct server*, const char*);
 void server_set_004(struct server*, char*);
 void server_set_005(struct server*, char*);
 
+/* Return the value of a numeric 005 token, "" if advertised
+ * without a value, or NULL if not advertised */
+const char* server_isupport(const struct server*, const char*);
+
+/* Return the maximum number of targets of a command, 0: unlimited */
+unsigned server_targmax(const struct server*, const char*);
+
 void server_nick_set(struct server*, const char*);
 void server_nicks_next(struct server*);
 
+const char* server_lag_probe(struct server*);
+int server_lag_pong(struct server*, const char*);
+void server_lag_add(struct server*, unsigned);
+unsigned server_lag_pct(const struct server*, unsigned);
+unsigned server_lag_bucket_max(unsigned);
+
 void server_reset(struct server*);
 void server_free(struct server*);
 
@@ -88,7 +88,7 @@ static void draw_status(struct channel*);
 static void draw_attr_bg(int);
 static void draw_attr_fg(int);
 static void draw_attr_reset(void);
-static void draw_char(int);
+static void draw_char(unsigned char);
 static void draw_clear_full(void);
 static void draw_clear_line(void);
 static void draw_cursor_pos(int, int);
@@ -636,13 +636,13 @@ static void
 draw_status(struct channel *c)
 {
 	/* server buffer:
-	 *  -[+usermodes]-(ping)-(scrollback)
+	 *  -[+usermodes]-(ping|lag)-(scrollback)
 	 *
 	 * privmsg buffer:
-	 *  -[+usermodes]-[privmsg]-(ping)-(scrollback)
+	 *  -[+usermodes]-[privmsg]-(ping|lag)-(scrollback)
 	 *
 	 * channel buffer:
-	 *  -[+usermodes]-[+chanmodes chancount]-(ping)-(scrollback)
+	 *  -[+usermodes]-[+chanmodes chancount]-(ping|lag)-(scrollback)
 	 */
 
 	#define STATUS_SEP_HORZ \
@@ -689,6 +689,14 @@ draw_status(struct channel *c)
 			return;
 	}
 
+	/* -(lag) */
+	if (c->server && !c->server->ping && c->server->connected && c->server->lag.count) {
+		if (!drawf(&cols, STATUS_SEP_HORZ))
+			return;
+		if (!drawf(&cols, "(%ums)", c->server->lag.last))
+			return;
+	}
+
 	/* -(scrollback) */
 	if ((scrollback = buffer_scrollback_status(&c->buffer))) {
 		if (!drawf(&cols, STATUS_SEP_HORZ))
@@ -768,7 +776,7 @@ drawf(unsigned *cols_p, const char *fmt, ...)
 					draw_attr_fg(va_arg(arg, int));
 					break;
 				case 'c':
-					draw_char(va_arg(arg, int));
+					draw_char((unsigned char) va_arg(arg, int));
 					cols--;
 					break;
 				case 'd':
@@ -846,7 +854,7 @@ draw_clear_line(void)
 }
 
 static void
-draw_char(int c)
+draw_char(unsigned char c)
 {
 	if (iscntrl(c)) {
 		int ctrl_bg_last = bg_last;
@@ -36,6 +36,8 @@ static int irc_generic_info(struct server*, struct irc_message*);
 static int irc_generic_unknown(struct server*, struct irc_message*);
 
 /* Numeric handlers */
+static int irc_recv_autojoin(struct server*);
+
 static int irc_numeric_001(struct server*, struct irc_message*);
 static int irc_numeric_004(struct server*, struct irc_message*);
 static int irc_numeric_005(struct server*, struct irc_message*);
@@ -48,9 +50,13 @@ static int irc_numeric_333(struct server*, struct irc_message*);
 static int irc_numeric_353(struct server*, struct irc_message*);
 static int irc_numeric_401(struct server*, struct irc_message*);
 static int irc_numeric_403(struct server*, struct irc_message*);
+static int irc_numeric_376(struct server*, struct irc_message*);
+static int irc_numeric_422(struct server*, struct irc_message*);
 static int irc_numeric_433(struct server*, struct irc_message*);
 
 static int irc_recv_numeric(struct server*, struct irc_message*);
+static void recv_ircv3_batch_end(struct server*, struct ircv3_batch*);
+static void recv_ircv3_batch_group(struct server*, struct ircv3_batch*, const char**, struct channel**, unsigned);
 static int recv_mode_chanmodes(struct irc_message*, const struct mode_cfg*, struct server*, struct channel*);
 static int recv_mode_usermodes(struct irc_message*, const struct mode_cfg*, struct server*);
 
@@ -152,7 +158,7 @@ static const irc_recv_f irc_numerics[] = {
 	[372] = irc_generic_info,   /* RPL_MOTD */
 	[374] = irc_generic_ignore, /* RPL_ENDOFINFO */
 	[375] = irc_generic_ignore, /* RPL_MOTDSTART */
-	[376] = irc_generic_ignore, /* RPL_ENDOFMOTD */
+	[376] = irc_numeric_376,    /* RPL_ENDOFMOTD */
 	[381] = irc_generic_info,   /* RPL_YOUREOPER */
 	[391] = irc_generic_info,   /* RPL_TIME */
 	[396] = irc_generic_info,   /* RPL_VISIBLEHOST */
@@ -173,7 +179,7 @@ static const irc_recv_f irc_numerics[] = {
 	[415] = irc_generic_error,  /* ERR_BADMASK */
 	[416] = irc_generic_error,  /* ERR_TOOMANYMATCHES */
 	[421] = irc_generic_error,  /* ERR_UNKNOWNCOMMAND */
-	[422] = irc_generic_error,  /* ERR_NOMOTD */
+	[422] = irc_numeric_422,    /* ERR_NOMOTD */
 	[423] = irc_generic_error,  /* ERR_NOADMININFO */
 	[431] = irc_generic_error,  /* ERR_NONICKNAMEGIVEN */
 	[432] = irc_generic_error,  /* ERR_ERRONEUSNICKNAME */
@@ -227,6 +233,67 @@ irc_recv(struct server *s, struct irc_message *m)
 	return irc_generic_unknown(s, m);
 }
 
+int
+irc_recv_batched(struct server *s, const char *line, size_t len)
+{
+	/* Lines are parsed from a copy, unbatched lines are parsed
+	 * again in place as received. Nested batches are opened when
+	 * their parent ends, until then their lines are buffered with
+	 * the outermost batch */
+
+	static char buf[TEXT_LENGTH_MAX + 1];
+	char *nested;
+	char *type;
+	const char *ref;
+	struct ircv3_batch *b;
+	struct ircv3_batch *root;
+	struct irc_message m;
+
+	if (!s->batches || *line != '@' || len >= sizeof(buf))
+		return 0;
+
+	memcpy(buf, line, len);
+	buf[len] = 0;
+
+	if (irc_message_parse(&m, buf))
+		return 0;
+
+	if (!(ref = irc_message_tag_key(&m, IRC_MESSAGE_TAG_BATCH)))
+		return 0;
+
+	if (!(b = ircv3_batch_get(s->batches, ref)))
+		return 0;
+
+	for (root = b; root->parent; root = root->parent)
+		;
+
+	if (ircv3_batch_line(root, line, len))
+		return 0;
+
+	if (strcmp(m.command, "BATCH") || !irc_message_param(&m, &nested) || !*nested || !*(nested + 1))
+		return 1;
+
+	if (*nested == '+' && irc_message_param(&m, &type) && !ircv3_batch_get(s->batches, nested + 1)) {
+		b = ircv3_batch(nested + 1, type, NULL);
+		b->parent = root;
+		b->next = s->batches;
+		s->batches = b;
+	}
+
+	if (*nested == '-') {
+		for (struct ircv3_batch **bp = &(s->batches); *bp; bp = &((*bp)->next)) {
+			if ((*bp)->parent && !strcmp((*bp)->ref, nested + 1)) {
+				b = *bp;
+				*bp = b->next;
+				ircv3_batch_free(b);
+				break;
+			}
+		}
+	}
+
+	return 1;
+}
+
 static int
 irc_generic(struct server *s, struct irc_message *m, const char *command, const char *from)
 {
@@ -235,12 +302,12 @@ irc_generic(struct server *s, struct irc_message *m, const char *command, const
 	 *   [command] [params] ~ trailing
 	 */
 
-	const char *params       = NULL;
+	char *params             = NULL;
+	char *trailing           = NULL;
 	const char *params_sep   = NULL;
-	const char *trailing     = NULL;
 	const char *trailing_sep = NULL;
 
-	if (!command && !irc_strtrim(&m->params))
+	if (!command && m->n_params_read == m->n_params)
 		return 1;
 
 	irc_message_split(m, &params, &trailing);
@@ -303,21 +370,68 @@ irc_generic_unknown(struct server *s, struct irc_message *m)
 }
 
 static int
-irc_numeric_001(struct server *s, struct irc_message *m)
+irc_recv_autojoin(struct server *s)
 {
-	/* 001 :<Welcome message> */
-
-	const char *params;
-	const char *trailing;
+	/* Join channels once per registration, at the end of the MOTD, once
+	 * ISUPPORT is known, in as few lines as TARGMAX and line length allow.
+	 *
+	 * Servers sending no MOTD numeric are assumed to have finished
+	 * registration by the first PING or PONG after 001, i.e. the server's
+	 * keepalive or the reply to the client's latency probe */
+
+	char *chans;
+	char *join;
+	char *list;
+	int ret = 0;
+	size_t len = 0;
 	struct channel *c = s->channel;
 
-	s->registered = 1;
+	if (!s->autojoin)
+		return 0;
+
+	s->autojoin = 0;
 
 	do {
-		if (c->type == CHANNEL_T_CHANNEL && !c->parted)
-			sendf(s, "JOIN %s", c->name);
+		if (c->type == CHANNEL_T_CHANNEL && !c->joined && !c->parted)
+			len += strlen(c->name) + 1;
 	} while ((c = c->next) != s->channel);
 
+	if (!len)
+		return 0;
+
+	if (!(list = chans = malloc(len)))
+		fatal("malloc: %s", strerror(errno));
+
+	do {
+		if (c->type == CHANNEL_T_CHANNEL && !c->joined && !c->parted) {
+			if (list != chans)
+				*list++ = ',';
+			list = stpcpy(list, c->name);
+		}
+	} while ((c = c->next) != s->channel);
+
+	for (list = chans; !ret && (join = irc_strlist(&list, server_targmax(s, "JOIN"), IRC_MESSAGE_LEN - 5)); )
+		ret = io_sendf(s->connection, "JOIN %s", join);
+
+	free(chans);
+
+	if (ret)
+		failf(s, "Send fail: %s", io_err(ret));
+
+	return 0;
+}
+
+static int
+irc_numeric_001(struct server *s, struct irc_message *m)
+{
+	/* 001 :<Welcome message> */
+
+	char *params;
+	char *trailing;
+
+	s->autojoin = 1;
+	s->registered = 1;
+
 	if (irc_message_split(m, &params, &trailing))
 		newlinef(s->channel, 0, FROM_INFO, "%s", trailing);
 
@@ -326,20 +440,41 @@ irc_numeric_001(struct server *s, struct irc_message *m)
 	return 0;
 }
 
+static int
+irc_numeric_376(struct server *s, struct irc_message *m)
+{
+	/* 376 :<End of MOTD> */
+
+	UNUSED(m);
+
+	return irc_recv_autojoin(s);
+}
+
+static int
+irc_numeric_422(struct server *s, struct irc_message *m)
+{
+	/* 422 :<MOTD File is missing> */
+
+	if (irc_generic_error(s, m))
+		return 1;
+
+	return irc_recv_autojoin(s);
+}
+
 static int
 irc_numeric_004(struct server *s, struct irc_message *m)
 {
 	/* 004 1*<params> [:message] */
 
-	const char *params;
-	const char *trailing;
+	char *params;
+	char *trailing;
 
 	if (irc_message_split(m, &params, &trailing))
 		newlinef(s->channel, 0, FROM_INFO, "%s ~ %s", params, trailing);
 	else
 		newlinef(s->channel, 0, FROM_INFO, "%s", params);
 
-	server_set_004(s, m->params);
+	server_set_004(s, params);
 
 	return 0;
 }
@@ -349,15 +484,15 @@ irc_numeric_005(struct server *s, struct irc_message *m)
 {
 	/* 005 1*<params> [:message] */
 
-	const char *params;
-	const char *trailing;
+	char *params;
+	char *trailing;
 
 	if (irc_message_split(m, &params, &trailing))
 		newlinef(s->channel, 0, FROM_INFO, "%s ~ %s", params, trailing);
 	else
 		newlinef(s->channel, 0, FROM_INFO, "%s ~ are supported by this server", params);
 
-	server_set_005(s, m->params);
+	server_set_005(s, params);
 
 	return 0;
 }
@@ -1109,7 +1244,10 @@ recv_notice(struct server *s, struct irc_message *m)
 	if (!(c = channel_list_get(&(s->clist), m->from, s->casemapping)))
 		c = s->channel;
 
-	newlinef(c, BUFFER_LINE_CHAT, m->from, "%s", message);
+	if (highlight_match(&(s->highlight), message))
+		newlinef(c, BUFFER_LINE_PINGED, m->from, "%s", message);
+	else
+		newlinef(c, BUFFER_LINE_CHAT, m->from, "%s", message);
 
 	return 0;
 }
@@ -1177,7 +1315,7 @@ recv_ping(struct server *s, struct irc_message *m)
 
 	sendf(s, "PONG %s", server);
 
-	return 0;
+	return irc_recv_autojoin(s);
 }
 
 static int
@@ -1185,10 +1323,11 @@ recv_pong(struct server *s, struct irc_message *m)
 {
 	/* PONG <server> [<server2>] */
 
-	UNUSED(s);
-	UNUSED(m);
+	/* Latency probe tokens are echoed as the final parameter */
+	if (m->n_params && server_lag_pong(s, m->params[m->n_params - 1]) == 0)
+		draw(DRAW_STATUS);
 
-	return 0;
+	return irc_recv_autojoin(s);
 }
 
 static int
@@ -1231,7 +1370,7 @@ recv_privmsg(struct server *s, struct irc_message *m)
 		failf(s, "PRIVMSG: channel '%s' not found", target);
 	}
 
-	if (irc_pinged(s->casemapping, message, s->nick)) {
+	if (highlight_match(&(s->highlight), message)) {
 
 		if (c != current_channel())
 			urgent = 1;
@@ -1381,6 +1520,187 @@ recv_ircv3_away(struct server *s, struct irc_message *m)
 	return 0;
 }
 
+static int
+recv_ircv3_batch(struct server *s, struct irc_message *m)
+{
+	/* BATCH +<reference> <type> [<params>]
+	 * BATCH -<reference> */
+
+	char *params = NULL;
+	char *ref;
+	char *trailing = NULL;
+	char *type;
+	struct ircv3_batch *b;
+	struct ircv3_batch **bp;
+
+	if (!irc_message_param(m, &ref))
+		failf(s, "BATCH: reference is null");
+
+	if ((*ref != '+' && *ref != '-') || !*(ref + 1))
+		failf(s, "BATCH: invalid reference '%s'", ref);
+
+	if (*ref == '+') {
+
+		if (!irc_message_param(m, &type))
+			failf(s, "BATCH: type is null");
+
+		if (ircv3_batch_get(s->batches, ref + 1))
+			failf(s, "BATCH: duplicate reference '%s'", ref + 1);
+
+		irc_message_split(m, &params, &trailing);
+
+		b = ircv3_batch(ref + 1, type, (params ? params : trailing));
+		b->next = s->batches;
+		s->batches = b;
+
+		return 0;
+	}
+
+	for (bp = &(s->batches); *bp; bp = &((*bp)->next)) {
+		if (!strcmp((*bp)->ref, ref + 1))
+			break;
+	}
+
+	if (!(b = *bp))
+		failf(s, "BATCH: reference '%s' not found", ref + 1);
+
+	*bp = b->next;
+
+	/* Nested batches not yet ended */
+	for (bp = &(s->batches); *bp;) {
+
+		struct ircv3_batch *root;
+
+		for (root = *bp; root->parent; root = root->parent)
+			;
+
+		if (root == b) {
+			root = *bp;
+			*bp = root->next;
+			ircv3_batch_free(root);
+		} else {
+			bp = &((*bp)->next);
+		}
+	}
+
+	recv_ircv3_batch_end(s, b);
+
+	ircv3_batch_free(b);
+
+	return 0;
+}
+
+static void
+recv_ircv3_batch_end(struct server *s, struct ircv3_batch *b)
+{
+	/* Handle the lines of an ended batch in order. Consecutive
+	 * JOINs of a netjoin and QUITs of a netsplit are applied as a
+	 * group, see recv_ircv3_batch_group */
+
+	char *line = b->lines;
+	const char **nicks = NULL;
+	const char *group = NULL;
+	struct channel **chans = NULL;
+	unsigned n = 0;
+
+	if (!strcmp(b->type, "netjoin"))
+		group = "JOIN";
+
+	if (!strcmp(b->type, "netsplit"))
+		group = "QUIT";
+
+	if (group && b->count) {
+
+		if ((nicks = calloc(b->count, sizeof(*nicks))) == NULL)
+			fatal("calloc: %s", strerror(errno));
+
+		if ((chans = calloc(b->count, sizeof(*chans))) == NULL)
+			fatal("calloc: %s", strerror(errno));
+	}
+
+	for (unsigned i = 0; i < b->count; i++) {
+
+		char *chan = NULL;
+		size_t len = strlen(line);
+		struct irc_message m;
+
+		if (irc_recv_batched(s, line, len))
+			goto next;
+
+		if (irc_message_parse(&m, line) != 0) {
+			newlinef(s->channel, 0, FROM_ERROR, "failed to parse message");
+			goto next;
+		}
+
+		if (group && m.from && !strcmp(m.command, group)
+		 && (*group == 'Q' || (irc_message_param(&m, &chan) && strcmp(m.from, s->nick)))) {
+			nicks[n] = m.from;
+			chans[n] = (chan ? channel_list_get(&s->clist, chan, s->casemapping) : NULL);
+			n++;
+			goto next;
+		}
+
+		if (n) {
+			recv_ircv3_batch_group(s, b, nicks, chans, n);
+			n = 0;
+		}
+
+		irc_recv(s, &m);
+
+next:
+		line += len + 1;
+	}
+
+	if (n)
+		recv_ircv3_batch_group(s, b, nicks, chans, n);
+
+	free(nicks);
+	free(chans);
+}
+
+static void
+recv_ircv3_batch_group(
+	struct server *s,
+	struct ircv3_batch *b,
+	const char **nicks,
+	struct channel **chans,
+	unsigned n)
+{
+	/* Add or remove users per channel, with a single line each.
+	 * Users join the channel given, or quit from all channels */
+
+	int join = !strcmp(b->type, "netjoin");
+	struct channel *c = s->channel;
+
+	do {
+		unsigned count = 0;
+
+		for (unsigned i = 0; i < n; i++) {
+			if (join) {
+				if (chans[i] == c && user_list_add(&(c->users), s->casemapping, nicks[i], MODE_EMPTY) == USER_ERR_NONE)
+					count++;
+			} else {
+				if (user_list_del(&(c->users), s->casemapping, nicks[i]) == USER_ERR_NONE)
+					count++;
+			}
+		}
+
+		if (!count)
+			continue;
+
+		if (join && (!threshold_join || threshold_join > c->users.count))
+			newlinef(c, BUFFER_LINE_JOIN, FROM_JOIN, "Netjoin%s%s, %u %s joined",
+				(*b->params ? " " : ""), b->params, count, (count == 1 ? "user has" : "users have"));
+
+		if (!join && (!threshold_quit || threshold_quit > c->users.count))
+			newlinef(c, BUFFER_LINE_QUIT, FROM_QUIT, "Netsplit%s%s, %u %s quit",
+				(*b->params ? " " : ""), b->params, count, (count == 1 ? "user has" : "users have"));
+
+	} while ((c = c->next) != s->channel);
+
+	draw(DRAW_STATUS);
+}
+
 static int
 recv_ircv3_chghost(struct server *s, struct irc_message *m)
 {
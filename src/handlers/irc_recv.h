@@ -359,6 +359,10 @@
  *
  *     7.4 SASL
  *         --- NOT IMPLEMENTED ---
+ *
+ *     7.5 BATCH
+ *         :<from> BATCH +<reference> <type> [<params>]
+ *         :<from> BATCH -<reference>
  */
 
 #include "src/components/server.h"
@@ -366,4 +370,8 @@
 
 int irc_recv(struct server*, struct irc_message*);
 
+/* Buffer a received line tagged as part of an open IRCv3 batch,
+ * handled when the batch ends. Returns 1 if buffered */
+int irc_recv_batched(struct server*, const char*, size_t);
+
 #endif
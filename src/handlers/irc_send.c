@@ -23,6 +23,8 @@
 	} while (0)
 
 static const char* irc_send_target(struct channel*, char*);
+static int irc_send_modes(struct server*, struct channel*, char*, char, char, const char*);
+static int irc_send_targets(struct server*, struct channel*, const char*, char*, char*, const char*);
 
 int
 irc_send_command(struct server *s, struct channel *c, char *m)
@@ -96,6 +98,94 @@ irc_send_target(struct channel *c, char *m)
 	return NULL;
 }
 
+static int
+irc_send_modes(struct server *s, struct channel *c, char *m, char set, char flag, const char *usage)
+{
+	/* Set or unset a mode with parameter for each of a space separated
+	 * list, up to MODES per line */
+
+	char flags[100 + 2] = { set };
+	char params[IRC_MESSAGE_LEN + 1];
+	char *p;
+	size_t len = 0;
+	size_t len_max;
+	unsigned n = 0;
+
+	if (c->type != CHANNEL_T_CHANNEL)
+		failf(c, "This is not a channel");
+
+	if (!irc_strtrim(&m))
+		failf(c, "Usage: %s", usage);
+
+	/* "MODE <channel> <flags> <params>" */
+	len_max = strlen(c->name) + s->mode_cfg.MODES + 8;
+	len_max = (len_max < IRC_MESSAGE_LEN ? IRC_MESSAGE_LEN - len_max : 0);
+
+	do {
+		size_t p_len = 0;
+
+		if ((p = irc_strsep(&m)))
+			p_len = strlen(p);
+
+		if (n && (!p || n == s->mode_cfg.MODES || len + p_len + 1 > len_max)) {
+			flags[n + 1] = 0;
+			sendf(s, c, "MODE %s %s %s", c->name, flags, params);
+			len = 0;
+			n = 0;
+		}
+
+		if (p) {
+
+			if (p_len > len_max)
+				failf(c, "Parameter too long: %s", p);
+
+			if (n)
+				params[len++] = ' ';
+
+			memcpy(params + len, p, p_len + 1);
+			len += p_len;
+			flags[++n] = flag;
+		}
+	} while (p);
+
+	return 0;
+}
+
+static int
+irc_send_targets(struct server *s, struct channel *c, const char *command, char *targets, char *keys, const char *trailing)
+{
+	/* Send a command to a comma separated list of targets, with optional
+	 * positional keys, in as few lines as TARGMAX and line length allow */
+
+	char *k;
+	char *t;
+	size_t len = strlen(command) + 1;
+	unsigned max = server_targmax(s, command);
+
+	if (keys)
+		len += strlen(keys) + 1;
+
+	if (trailing)
+		len += strlen(trailing) + 2;
+
+	while ((t = irc_strlist(&targets, max, (len < IRC_MESSAGE_LEN ? IRC_MESSAGE_LEN - len : 0)))) {
+
+		unsigned n = 1;
+
+		for (const char *p = t; (p = strchr(p, ',')); p++)
+			n++;
+
+		if ((k = irc_strlist(&keys, n, SIZE_MAX)))
+			sendf(s, c, "%s %s %s", command, t, k);
+		else if (trailing)
+			sendf(s, c, "%s %s :%s", command, t, trailing);
+		else
+			sendf(s, c, "%s %s", command, t);
+	}
+
+	return 0;
+}
+
 static int
 irc_send_away(struct server *s, struct channel *c, char *m)
 {
@@ -107,10 +197,42 @@ irc_send_away(struct server *s, struct channel *c, char *m)
 	return 0;
 }
 
+static int
+irc_send_ban(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '+', 'b', "/ban <mask> [mask ...]");
+}
+
+static int
+irc_send_deop(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '-', 'o', "/deop <nick> [nick ...]");
+}
+
+static int
+irc_send_devoice(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '-', 'v', "/devoice <nick> [nick ...]");
+}
+
+static int
+irc_send_join(struct server *s, struct channel *c, char *m)
+{
+	char *keys;
+	char *targets;
+
+	if (!(targets = irc_strsep(&m)))
+		failf(c, "Usage: /join <channel>[,channel ...] [key[,key ...]]");
+
+	keys = irc_strsep(&m);
+
+	return irc_send_targets(s, c, "JOIN", targets, keys, NULL);
+}
+
 static int
 irc_send_notice(struct server *s, struct channel *c, char *m)
 {
-	const char *target;
+	char *target;
 
 	if (!(target = irc_strsep(&m)))
 		failf(c, "Usage: /notice <target> <message>");
@@ -118,21 +240,40 @@ irc_send_notice(struct server *s, struct channel *c, char *m)
 	if (!m || !*m)
 		failf(c, "Usage: /notice <target> <message>");
 
-	sendf(s, c, "NOTICE %s :%s", target, m);
+	return irc_send_targets(s, c, "NOTICE", target, NULL, m);
+}
 
-	return 0;
+static int
+irc_send_op(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '+', 'o', "/op <nick> [nick ...]");
 }
 
 static int
 irc_send_part(struct server *s, struct channel *c, char *m)
 {
+	/* /part [channel[,channel ...]] [message] */
+
+	const char *chantypes;
+	const char *mesg = DEFAULT_PART_MESG;
+	char *targets = NULL;
+
+	if (!(chantypes = server_isupport(s, "CHANTYPES")))
+		chantypes = "#&";
+
+	if (irc_strtrim(&m) && strchr(chantypes, *m))
+		targets = irc_strsep(&m);
+
+	if (irc_strtrim(&m))
+		mesg = m;
+
+	if (targets)
+		return irc_send_targets(s, c, "PART", targets, NULL, mesg);
+
 	if (c->type != CHANNEL_T_CHANNEL)
 		failf(c, "This is not a channel");
 
-	if (irc_strtrim(&m))
-		sendf(s, c, "PART %s :%s", c->name, m);
-	else
-		sendf(s, c, "PART %s :%s", c->name, DEFAULT_PART_MESG);
+	sendf(s, c, "PART %s :%s", c->name, mesg);
 
 	return 0;
 }
@@ -140,7 +281,7 @@ irc_send_part(struct server *s, struct channel *c, char *m)
 static int
 irc_send_privmsg(struct server *s, struct channel *c, char *m)
 {
-	const char *target;
+	char *target;
 	char *dup;
 	char *p1;
 	char *p2;
@@ -179,9 +320,7 @@ irc_send_privmsg(struct server *s, struct channel *c, char *m)
 
 	free(dup);
 
-	sendf(s, c, "PRIVMSG %s :%s", target, m);
-
-	return 0;
+	return irc_send_targets(s, c, "PRIVMSG", target, NULL, m);
 }
 
 static int
@@ -225,6 +364,18 @@ irc_send_topic_unset(struct server *s, struct channel *c, char *m)
 	return 0;
 }
 
+static int
+irc_send_unban(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '-', 'b', "/unban <mask> [mask ...]");
+}
+
+static int
+irc_send_voice(struct server *s, struct channel *c, char *m)
+{
+	return irc_send_modes(s, c, m, '+', 'v', "/voice <nick> [nick ...]");
+}
+
 static int
 irc_send_ctcp_action(struct server *s, struct channel *c, char *m)
 {
@@ -1,33 +1,89 @@
 #include "src/io.h"
 
 #include "config.h"
+#include "src/io_uring.h"
 #include "src/rirc.h"
+#include "src/utils/capture.h"
+#include "src/utils/timer.h"
 #include "src/utils/utils.h"
 
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/error.h"
 #include "mbedtls/net_sockets.h"
+#include "mbedtls/platform_util.h"
 #include "mbedtls/ssl.h"
 #include "mbedtls/x509_crt.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#ifndef IO_TLS_KTLS
+#define IO_TLS_KTLS 0
+#elif (IO_TLS_KTLS < 0 || IO_TLS_KTLS > 1)
+#error "IO_TLS_KTLS: [0, 1]"
+#endif
+
+#if IO_TLS_KTLS && defined(__linux__)
+#define IO_KTLS
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
 /* RFC 2812, section 2.3 */
 #define IO_MESG_LEN 510
 
+/* RFC 8446, section 5.1, maximum record plaintext */
+#define IO_RECV_SIZE (1 << 14)
+
+/* Receive slots per connection, power of 2. Two slots let the connection
+ * thread read into one while the main thread consumes the other, more
+ * only add memory to every connection, idle or not */
+#define IO_RECV_SLOTS 2
+
+/* Outbound bytes batched per connection */
+#define IO_SEND_SIZE (1 << 12)
+
+/* io_uring queue size and provided buffers for stdin and wakeups */
+#define IO_URING_ENTRIES  64
+#define IO_URING_BUFS     16
+#define IO_URING_BUF_SIZE 128
+
+/* io_uring request data, any other value is a connection */
+#define IO_URING_INP  1
+#define IO_URING_WAKE 2
+
 #ifndef IO_PING_MIN
 #define IO_PING_MIN 150
 #elif (IO_PING_MIN < 0 || IO_PING_MIN > 86400)
@@ -46,6 +102,12 @@
 #error "IO_PING_MAX: [0, 86400]"
 #endif
 
+#ifndef IO_PROBE_INTERVAL
+#define IO_PROBE_INTERVAL 30
+#elif (IO_PROBE_INTERVAL < 0 || IO_PROBE_INTERVAL > 86400)
+#error "IO_PROBE_INTERVAL: [0, 86400]"
+#endif
+
 #ifndef IO_RECONNECT_BACKOFF_BASE
 #define IO_RECONNECT_BACKOFF_BASE 4
 #elif (IO_RECONNECT_BACKOFF_BASE < 1 || IO_RECONNECT_BACKOFF_BASE > 86400)
@@ -64,6 +126,42 @@
 #error "IO_RECONNECT_BACKOFF_MAX: [0, 86400]"
 #endif
 
+#ifndef IO_CONNECT_MAX
+#define IO_CONNECT_MAX 4
+#elif (IO_CONNECT_MAX < 1 || IO_CONNECT_MAX > 1024)
+#error "IO_CONNECT_MAX: [1, 1024]"
+#endif
+
+#ifndef IO_TCP_NODELAY
+#define IO_TCP_NODELAY 1
+#elif (IO_TCP_NODELAY < 0 || IO_TCP_NODELAY > 1)
+#error "IO_TCP_NODELAY: [0, 1]"
+#endif
+
+#ifndef IO_TCP_KEEPALIVE_IDLE
+#define IO_TCP_KEEPALIVE_IDLE 60
+#elif (IO_TCP_KEEPALIVE_IDLE < 0 || IO_TCP_KEEPALIVE_IDLE > 86400)
+#error "IO_TCP_KEEPALIVE_IDLE: [0, 86400]"
+#endif
+
+#ifndef IO_TCP_KEEPALIVE_INTVL
+#define IO_TCP_KEEPALIVE_INTVL 10
+#elif (IO_TCP_KEEPALIVE_INTVL < 1 || IO_TCP_KEEPALIVE_INTVL > 86400)
+#error "IO_TCP_KEEPALIVE_INTVL: [1, 86400]"
+#endif
+
+#ifndef IO_TCP_KEEPALIVE_CNT
+#define IO_TCP_KEEPALIVE_CNT 3
+#elif (IO_TCP_KEEPALIVE_CNT < 1 || IO_TCP_KEEPALIVE_CNT > 127)
+#error "IO_TCP_KEEPALIVE_CNT: [1, 127]"
+#endif
+
+#ifndef IO_TCP_USER_TIMEOUT
+#define IO_TCP_USER_TIMEOUT 90
+#elif (IO_TCP_USER_TIMEOUT < 0 || IO_TCP_USER_TIMEOUT > 86400)
+#error "IO_TCP_USER_TIMEOUT: [0, 86400]"
+#endif
+
 #define PT_CF(X) \
 	do {                           \
 		int _ptcf = (X);           \
@@ -79,11 +177,16 @@
 #define IO_CB(X) \
 	do { PT_LK(&io_cb_mutex); (X); PT_UL(&io_cb_mutex); } while (0)
 
-#define io_cxed(C)       IO_CB(io_cb_cxed((C)->obj))
-#define io_dxed(C)       IO_CB(io_cb_dxed((C)->obj))
-#define io_error(C, ...) IO_CB(io_cb_error((C)->obj,  __VA_ARGS__))
-#define io_info(C, ...)  IO_CB(io_cb_info((C)->obj, __VA_ARGS__))
-#define io_ping(C, P)    IO_CB(io_cb_ping((C)->obj, P))
+/* IO connection callback, ordered after received data */
+#define IO_CX_CB(C, X) \
+	IO_CB((io_cx_drain((C)), (X)))
+
+#define io_cxed(C)       IO_CX_CB((C), io_cb_cxed((C)->obj))
+#define io_dxed(C)       IO_CX_CB((C), io_cb_dxed((C)->obj))
+#define io_error(C, ...) IO_CX_CB((C), io_cb_error((C)->obj,  __VA_ARGS__))
+#define io_info(C, ...)  IO_CX_CB((C), io_cb_info((C)->obj, __VA_ARGS__))
+#define io_ping(C, P)    IO_CX_CB((C), io_cb_ping((C)->obj, P))
+#define io_probe(C)      IO_CX_CB((C), io_cb_probe((C)->obj))
 
 /* state transition */
 #define ST_X(OLD, NEW) (((OLD) << 3) | (NEW))
@@ -100,9 +203,31 @@ enum io_err
 	IO_ERR_TRUNC,
 };
 
+struct io_transport
+{
+	/* Connection transport, functions return values as mbedtls_net_recv
+	 * and mbedtls_net_send, connect returns non-zero on failure */
+	int (*connect)(struct connection*);
+	int (*recv)(struct connection*, unsigned char*, size_t);
+	int (*send)(struct connection*, const unsigned char*, size_t);
+	void (*close)(struct connection*);
+};
+
+struct io_send
+{
+	/* io_uring send in flight, owning its buffer */
+	struct connection *cx; /* NULL once the connection is freed */
+	unsigned char *buf;
+	size_t len;
+};
+
 struct connection
 {
+	struct connection *next;
+	const struct io_transport *tp;
 	const void *obj;
+	FILE *capture;
+	struct connection *rx_next; /* waiting on io_rx_mutex state, see io_rx_wait_add */
 	const char *host;
 	const char *port;
 	enum io_state {
@@ -115,46 +240,171 @@ struct connection
 	} st_cur, /* current thread state */
 	  st_new; /* new thread state */
 	mbedtls_net_context net_ctx;
-	mbedtls_ssl_config  tls_conf;
+	const mbedtls_ssl_config *tls_conf; /* shared, by verification mode */
 	mbedtls_ssl_context tls_ctx;
+	mbedtls_ssl_session tls_session; /* saved for resumption on reconnect */
 	pthread_mutex_t mtx;
 	pthread_t tid;
+	int wake_fd[2]; /* wakes the connection thread to check for a new state */
+	struct io_tcp_opts tcp;
+	struct timer timer; /* deadline of the connection thread's wait, see io_cx_poll */
 	uint32_t flags;
 	unsigned ping;
+	unsigned rx_seed;
 	unsigned rx_sleep;
+	unsigned tls_session_set : 1;
+	unsigned ktls_rx : 1; /* kernel TLS record decryption */
+	unsigned ktls_tx : 1; /* kernel TLS record encryption */
+	unsigned ktls_off : 1; /* kernel TLS disabled after a partial offload */
+#ifdef IO_KTLS
+	struct {
+		mbedtls_tls_prf_types prf;
+		unsigned char secret[48];
+		unsigned char random[64]; /* server_random || client_random */
+		unsigned set : 1;
+	} tls_keys;
+#endif
+	struct {
+		/* Lines written by the main thread while handling a batch of
+		 * io_uring completions, submitted together after the batch.
+		 * Lines written while a send is in flight are queued behind
+		 * it, by any holder of io_cb_mutex, and submitted after its
+		 * completion */
+		struct io_send *inflight;
+		size_t len;
+		size_t size;
+		unsigned char *buf;
+	} send;
+	struct {
+		/* Single producer, single consumer ring of receive slots
+		 *
+		 * The connection thread reads into slot[head] and publishes
+		 * complete lines by advancing head. Published slots are
+		 * consumed by the holder of io_cb_mutex, advancing tail */
+		atomic_uint head;
+		atomic_uint tail;
+		atomic_int wait; /* producer blocked on a full ring */
+		pthread_cond_t cnd;
+		size_t len; /* bytes read into slot[head] */
+		unsigned discard : 1; /* discarding remainder of an oversized line */
+		struct {
+			size_t len;
+			char buf[IO_RECV_SIZE];
+		} slot[IO_RECV_SLOTS];
+	} read;
 };
 
 static enum io_state io_state_cxed(struct connection*);
 static enum io_state io_state_cxng(struct connection*);
 static enum io_state io_state_ping(struct connection*);
 static enum io_state io_state_rxng(struct connection*);
-static int io_cx_read(struct connection*, uint32_t);
+static int io_cx_frame(struct connection*, size_t);
+static int io_cx_publish(struct connection*, size_t);
+static int io_cx_read(struct connection*, unsigned long long);
+static void io_cx_capture(struct connection*, enum capture_dir, const char*, size_t);
+static void io_cx_capture_open(struct connection*);
+static int io_cx_send(struct connection*, const unsigned char*, size_t);
+static void io_cx_drain(struct connection*);
+static int io_cx_slot_get(struct connection*);
+static int io_cx_poll(struct connection*, int, short, unsigned long long);
+static void io_cx_slot_put(void);
+static void io_cx_timer(struct connection*, unsigned long long);
+static void io_cx_timer_cb(struct timer*);
+static void io_cx_wake(struct connection*);
+static void io_cx_wake_init(struct connection*);
 static void io_fatal(const char*, int);
+static unsigned long long io_time_ms(void);
 static void io_sig_handle(int);
 static void io_sig_init(void);
+static void io_start_poll(void);
+static int io_start_uring(void);
+static int io_timer_run(void);
 static void io_tty_init(void);
 static void io_tty_term(void);
 static void io_tty_winsize(void);
+static void io_uring_cqe(const struct uring_cqe*);
+static void io_uring_flush(void);
+static void io_uring_send_cqe(const struct uring_cqe*);
+static void io_wake(void);
+static void io_wake_init(void);
 static void* io_thread(void*);
 
-static int io_running;
+static atomic_int io_wake_pending;
+static int io_wake_fd[2] = {-1, -1};
+static atomic_int io_running;
+static int io_batch; /* main thread holding io_cb_mutex is batching sends */
+static struct uring *io_uring;
+static struct connection *io_cx_list; /* modified by the main thread only */
 static mbedtls_ctr_drbg_context tls_ctr_drbg;
 static mbedtls_entropy_context  tls_entropy;
 static mbedtls_x509_crt         tls_x509_crt;
+static mbedtls_ssl_config tls_conf_vrfy_disabled;
+static mbedtls_ssl_config tls_conf_vrfy_optional;
+static mbedtls_ssl_config tls_conf_vrfy_required;
+static pthread_mutex_t tls_x509_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int tls_x509_loaded; /* CA bundle parsed, retried until success */
 static pthread_mutex_t io_cb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t io_rx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct connection *io_rx_waiters; /* threads waiting on io_rx_gen or a connection slot */
+static unsigned io_rx_gen; /* incremented on any successful connection */
+static unsigned io_cx_active; /* connection attempts in progress */
+static pthread_mutex_t io_timer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct timer_wheel io_timers; /* run by the main thread */
+static uint64_t io_timer_wait = TIMER_NONE; /* tick awaited by the main thread */
 static struct termios term;
 static volatile sig_atomic_t flag_sigwinch_cb; /* sigwinch callback */
 
 static const char* io_strerror(char*, size_t);
 static int io_net_connect(struct connection*);
+static int io_net_connect_soc(struct connection*, int, const struct sockaddr*, socklen_t);
 static void io_net_close(int);
+static void io_net_setsockopt(struct connection*, int, int, int, const char*, int);
+static void io_net_tcp_opts(struct connection*, int);
+static void io_rx_notify(void);
+static void io_rx_wait_add(struct connection*);
+static void io_rx_wait_del(struct connection*);
+
+static int io_soc_recv(struct connection*, unsigned char*, size_t);
+static int io_soc_send(struct connection*, const unsigned char*, size_t);
+static void io_soc_close(struct connection*);
+static int io_tcp_connect(struct connection*);
+static int io_tls_connect(struct connection*);
+static int io_tls_recv(struct connection*, unsigned char*, size_t);
+static int io_tls_send(struct connection*, const unsigned char*, size_t);
+static void io_tls_close(struct connection*);
+static int io_unix_connect(struct connection*);
+static int io_loop_connect(struct connection*);
+
+static const struct io_transport io_tp_tcp  = { io_tcp_connect,  io_soc_recv, io_soc_send, io_soc_close };
+static const struct io_transport io_tp_tls  = { io_tls_connect,  io_tls_recv, io_tls_send, io_tls_close };
+static const struct io_transport io_tp_unix = { io_unix_connect, io_soc_recv, io_soc_send, io_soc_close };
+static const struct io_transport io_tp_loop = { io_loop_connect, io_soc_recv, io_soc_send, io_soc_close };
+
+static void (*io_loop_accept)(int, void*);
+static void *io_loop_arg;
 
 /* TLS */
 static const char* io_tls_err(int);
 static int io_tls_establish(struct connection*);
+static void io_tls_session_save(struct connection*);
 static int io_tls_x509_vrfy(struct connection*);
+static void io_tls_conf_init(mbedtls_ssl_config*, int);
 static void io_tls_init(void);
 static void io_tls_term(void);
+static int io_tls_x509_load(void);
+
+#ifdef IO_KTLS
+static int io_ktls_init(struct connection*);
+static int io_ktls_recv(struct connection*, unsigned char*, size_t);
+static void io_ktls_export_keys(
+	void*,
+	mbedtls_ssl_key_export_type,
+	const unsigned char*,
+	size_t,
+	const unsigned char[32],
+	const unsigned char[32],
+	mbedtls_tls_prf_types);
+#endif
 
 const char *ca_cert_paths[] = {
 	"/etc/ssl/ca-bundle.pem",
@@ -173,21 +423,99 @@ connection(const void *obj, const char *host, const char *port, uint32_t flags)
 	if ((cx = calloc(1U, sizeof(*cx))) == NULL)
 		fatal("malloc: %s", strerror(errno));
 
+	if (flags & IO_LOOPBACK)
+		cx->tp = &io_tp_loop;
+	else if (flags & IO_UNIX)
+		cx->tp = &io_tp_unix;
+	else if (flags & IO_TLS_ENABLED)
+		cx->tp = &io_tp_tls;
+	else
+		cx->tp = &io_tp_tcp;
+
 	cx->obj = obj;
 	cx->flags = flags;
 	cx->host = strdup(host);
 	cx->port = strdup(port);
 	cx->st_cur = IO_ST_DXED;
 	cx->st_new = IO_ST_INVALID;
+	cx->rx_seed = (unsigned)time(NULL) ^ (unsigned)(uintptr_t)cx;
+	cx->tcp.nodelay = IO_TCP_NODELAY;
+	cx->tcp.keepidle = IO_TCP_KEEPALIVE_IDLE;
+	cx->tcp.keepintvl = IO_TCP_KEEPALIVE_INTVL;
+	cx->tcp.keepcnt = IO_TCP_KEEPALIVE_CNT;
+	cx->tcp.user_timeout = IO_TCP_USER_TIMEOUT;
+
+	if (flags & IO_TLS_VRFY_DISABLED)
+		cx->tls_conf = &tls_conf_vrfy_disabled;
+	else if (flags & IO_TLS_VRFY_OPTIONAL)
+		cx->tls_conf = &tls_conf_vrfy_optional;
+	else
+		cx->tls_conf = &tls_conf_vrfy_required;
+	mbedtls_ssl_session_init(&(cx->tls_session));
 	PT_CF(pthread_mutex_init(&(cx->mtx), NULL));
+	PT_CF(pthread_cond_init(&(cx->read.cnd), NULL));
+	io_cx_wake_init(cx);
+	timer_init(&(cx->timer), io_cx_timer_cb, cx);
+
+	cx->next = io_cx_list;
+	io_cx_list = cx;
 
 	return cx;
 }
 
+void
+connection_tcp_opts(struct connection *cx, const struct io_tcp_opts *opts)
+{
+	PT_LK(&(cx->mtx));
+
+	if (opts->nodelay >= 0)
+		cx->tcp.nodelay = opts->nodelay;
+
+	if (opts->keepidle >= 0)
+		cx->tcp.keepidle = opts->keepidle;
+
+	if (opts->keepintvl >= 0)
+		cx->tcp.keepintvl = opts->keepintvl;
+
+	if (opts->keepcnt >= 0)
+		cx->tcp.keepcnt = opts->keepcnt;
+
+	if (opts->user_timeout >= 0)
+		cx->tcp.user_timeout = opts->user_timeout;
+
+	PT_UL(&(cx->mtx));
+}
+
 void
 connection_free(struct connection *cx)
 {
+	for (struct connection **c = &io_cx_list; *c; c = &(*c)->next) {
+		if (*c == cx) {
+			*c = cx->next;
+			break;
+		}
+	}
+
+	if (cx->capture)
+		fclose(cx->capture);
+
+	if (cx->send.inflight)
+		cx->send.inflight->cx = NULL;
+
+	free(cx->send.buf);
+
+	PT_LK(&io_timer_mutex);
+	timer_del(&io_timers, &(cx->timer));
+	PT_UL(&io_timer_mutex);
+
+	io_net_close(cx->wake_fd[0]);
+
+	if (cx->wake_fd[1] != cx->wake_fd[0])
+		io_net_close(cx->wake_fd[1]);
+
+	PT_CF(pthread_cond_destroy(&(cx->read.cnd)));
 	PT_CF(pthread_mutex_destroy(&(cx->mtx)));
+	mbedtls_ssl_session_free(&(cx->tls_session));
 	free((void*)cx->host);
 	free((void*)cx->port);
 	free(cx);
@@ -218,7 +546,7 @@ io_cx(struct connection *cx)
 			err = IO_ERR_CXED;
 			break;
 		case IO_ST_RXNG:
-			PT_CF(pthread_kill(cx->tid, SIGUSR1));
+			cx->st_new = IO_ST_CXNG;
 			break;
 		default:
 			fatal("unknown state");
@@ -226,6 +554,8 @@ io_cx(struct connection *cx)
 
 	PT_UL(&(cx->mtx));
 
+	io_cx_wake(cx);
+
 	return err;
 }
 
@@ -239,10 +569,12 @@ io_dx(struct connection *cx)
 
 	PT_LK(&(cx->mtx));
 	cx->st_new = IO_ST_DXED;
+	PT_CF(pthread_cond_broadcast(&(cx->read.cnd)));
 	PT_UL(&(cx->mtx));
 
+	io_cx_wake(cx);
+
 	PT_CF(pthread_detach(cx->tid));
-	PT_CF(pthread_kill(cx->tid, SIGUSR1));
 
 	return err;
 }
@@ -253,7 +585,6 @@ io_sendf(struct connection *cx, const char *fmt, ...)
 	unsigned char sendbuf[IO_MESG_LEN + 2];
 	int ret;
 	size_t len;
-	size_t written;
 	va_list ap;
 
 	if (cx->st_cur != IO_ST_CXED && cx->st_cur != IO_ST_PING)
@@ -273,35 +604,43 @@ io_sendf(struct connection *cx, const char *fmt, ...)
 
 	debug_send(len, sendbuf);
 
+	if (cx->capture)
+		io_cx_capture(cx, CAPTURE_SEND, (char *)sendbuf, len);
+
 	sendbuf[len++] = '\r';
 	sendbuf[len++] = '\n';
 
-	ret = 0;
-	written = 0;
+	if ((cx->tp != &io_tp_tls || cx->ktls_tx) && (io_batch || cx->send.inflight || cx->send.len)) {
 
-	do {
-		if (cx->flags & IO_TLS_ENABLED) {
-			ret = mbedtls_ssl_write(&(cx->tls_ctx), sendbuf + ret, len - ret);
-		} else {
-			ret = mbedtls_net_send(&(cx->net_ctx), sendbuf + ret, len - ret);
+		if (!cx->send.inflight && cx->send.len + len > IO_SEND_SIZE) {
+
+			ret = io_cx_send(cx, cx->send.buf, cx->send.len);
+
+			cx->send.len = 0;
+
+			if (ret)
+				return ret;
 		}
 
-		if (ret >= 0)
-			continue;
+		if (cx->send.len + len > cx->send.size) {
 
-		switch (ret) {
-			case MBEDTLS_ERR_SSL_WANT_READ:
-			case MBEDTLS_ERR_SSL_WANT_WRITE:
-				ret = 0;
-				continue;
-			default:
-				io_dx(cx);
-				io_cx(cx);
-				return IO_ERR_SSL_WRITE;
+			cx->send.size = MAX(IO_SEND_SIZE, 2 * (cx->send.len + len));
+
+			if ((cx->send.buf = realloc(cx->send.buf, cx->send.size)) == NULL)
+				fatal("realloc: %s", strerror(errno));
 		}
-	} while ((written += ret) < len);
 
-	return IO_ERR_NONE;
+		memcpy(cx->send.buf + cx->send.len, sendbuf, len);
+		cx->send.len += len;
+
+		/* Queued outside of a batch, behind a send in flight */
+		if (!io_batch)
+			io_wake();
+
+		return IO_ERR_NONE;
+	}
+
+	return io_cx_send(cx, sendbuf, len);
 }
 
 void
@@ -310,6 +649,9 @@ io_init(void)
 	io_sig_init();
 	io_tty_init();
 	io_tls_init();
+	io_wake_init();
+
+	timer_wheel_init(&io_timers, io_time_ms());
 }
 
 void
@@ -319,30 +661,236 @@ io_start(void)
 
 	io_tty_winsize();
 
+	if (!io_uring_enabled || io_start_uring() < 0)
+		io_start_poll();
+}
+
+void
+io_stop(void)
+{
+	io_running = 0;
+	io_wake();
+}
+
+void
+io_loopback(void (*accept)(int, void*), void *arg)
+{
+	io_loop_accept = accept;
+	io_loop_arg = arg;
+}
+
+static void
+io_start_poll(void)
+{
 	while (io_running) {
 
 		char buf[128];
-		ssize_t ret = read(STDIN_FILENO, buf, sizeof(buf));
+		int ret;
+		struct pollfd fds[2] = {
+			{ .fd = STDIN_FILENO,  .events = POLLIN },
+			{ .fd = io_wake_fd[0], .events = POLLIN },
+		};
+
+		if ((ret = poll(fds, 2, io_timer_run())) < 0) {
+			if (errno != EINTR)
+				fatal("poll: %s", strerror(errno));
+			if (flag_sigwinch_cb) {
+				flag_sigwinch_cb = 0;
+				io_tty_winsize();
+			}
+			continue;
+		}
+
+		if (fds[1].revents) {
+
+			/* Clear the wakeup before draining, data published
+			 * after this point results in a new wakeup */
+
+			if (read(io_wake_fd[0], buf, sizeof(buf)) < 0 && errno != EINTR)
+				fatal("read: %s", strerror(errno));
+
+			atomic_store(&io_wake_pending, 0);
+
+			PT_LK(&io_cb_mutex);
+			for (struct connection *cx = io_cx_list; cx; cx = cx->next)
+				io_cx_drain(cx);
+			PT_UL(&io_cb_mutex);
+		}
+
+		if (fds[0].revents) {
+
+			ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+
+			if (n > 0)
+				IO_CB(io_cb_read_inp(buf, n));
+			else if (n == 0 || errno != EINTR)
+				fatal("read: %s", n ? strerror(errno) : "EOF");
+		}
+	}
+}
+
+static int
+io_start_uring(void)
+{
+	/* Stdin and wakeups are read by multishot requests into provided
+	 * buffers, rearmed only when terminated, such that each iteration
+	 * waits for any number of completions in a single system call.
+	 *
+	 * Completions are handled in a batch, during which lines written to
+	 * connections without userspace TLS are buffered and then submitted
+	 * together, their completions are reaped by a later iteration.
+	 *
+	 * Only stdin, wakeups and sends use io_uring. Connection sockets,
+	 * plaintext and kTLS included, are read by connection threads, which
+	 * own framing into receive slots, ping timeouts, latency probes and
+	 * reconnecting, through mbedtls for userspace TLS */
+
+	if ((io_uring = uring(IO_URING_ENTRIES, IO_URING_BUFS, IO_URING_BUF_SIZE)) == NULL)
+		return -1;
+
+	if (uring_read_multishot(io_uring, STDIN_FILENO, IO_URING_INP)
+	 || uring_read_multishot(io_uring, io_wake_fd[0], IO_URING_WAKE))
+		fatal("io_uring: submission queue full");
+
+	while (io_running) {
+
+		struct uring_cqe cqe;
+
+		int timeout = io_timer_run();
+
+		if (uring_submit_timeout(io_uring, 1, timeout) < 0 && errno != EINTR && errno != ETIME)
+			fatal("io_uring_enter: %s", strerror(errno));
+
+		if (flag_sigwinch_cb) {
+			flag_sigwinch_cb = 0;
+			io_tty_winsize();
+		}
+
+		PT_LK(&io_cb_mutex);
+
+		io_batch = 1;
+
+		while (uring_cqe_next(io_uring, &cqe))
+			io_uring_cqe(&cqe);
+
+		io_batch = 0;
+
+		io_uring_flush();
+
+		PT_UL(&io_cb_mutex);
+	}
+
+	uring_free(io_uring);
+	io_uring = NULL;
+
+	return 0;
+}
+
+static void
+io_uring_cqe(const struct uring_cqe *cqe)
+{
+	/* Handle a completion, caller holds io_cb_mutex */
+
+	int fd;
+
+	if (cqe->data != IO_URING_INP && cqe->data != IO_URING_WAKE) {
+		io_uring_send_cqe(cqe);
+		return;
+	}
+
+	if (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -EINTR)
+		fatal("read: %s", strerror(-cqe->res));
+
+	switch (cqe->data) {
+		case IO_URING_INP:
+			fd = STDIN_FILENO;
+			if (cqe->res == 0)
+				fatal("read: EOF");
+			if (cqe->res > 0)
+				io_cb_read_inp(cqe->buf, (size_t) cqe->res);
+			break;
+		case IO_URING_WAKE:
+			fd = io_wake_fd[0];
+			atomic_store(&io_wake_pending, 0);
+			for (struct connection *cx = io_cx_list; cx; cx = cx->next)
+				io_cx_drain(cx);
+			break;
+		default:
+			fatal("unknown completion");
+	}
+
+	if (cqe->buf)
+		uring_buf_put(io_uring, cqe->bid);
+
+	if (!cqe->more && uring_read_multishot(io_uring, fd, cqe->data))
+		fatal("io_uring: submission queue full");
+}
+
+static void
+io_uring_flush(void)
+{
+	/* Submit batched lines for all connections without a send in
+	 * flight, completions are reaped by the next iteration of the
+	 * main loop. Caller holds io_cb_mutex */
+
+	for (struct connection *cx = io_cx_list; cx; cx = cx->next) {
+
+		struct io_send *send;
 
-		if (ret > 0) {
-			IO_CB(io_cb_read_inp(buf, ret));
+		if (!cx->send.len || cx->send.inflight)
+			continue;
+
+		if ((cx->st_cur != IO_ST_CXED && cx->st_cur != IO_ST_PING)
+		 || (cx->tp == &io_tp_tls && !cx->ktls_tx)) {
+			cx->send.len = 0;
+			continue;
+		}
+
+		if ((send = malloc(sizeof(*send))) == NULL)
+			fatal("malloc: %s", strerror(errno));
+
+		send->cx = cx;
+		send->buf = cx->send.buf;
+		send->len = cx->send.len;
+
+		if (uring_send(io_uring, cx->net_ctx.MBEDTLS_PRIVATE(fd), send->buf, send->len, (uintptr_t)send) == 0) {
+			cx->send.inflight = send;
+			cx->send.buf = NULL;
+			cx->send.size = 0;
 		} else {
-			if (errno == EINTR) {
-				if (flag_sigwinch_cb) {
-					flag_sigwinch_cb = 0;
-					io_tty_winsize();
-				}
-			} else {
-				fatal("read: %s", ret ? strerror(errno) : "EOF");
-			}
+			free(send);
+			(void) io_cx_send(cx, cx->send.buf, cx->send.len);
 		}
+
+		cx->send.len = 0;
 	}
 }
 
-void
-io_stop(void)
+static void
+io_uring_send_cqe(const struct uring_cqe *cqe)
 {
-	io_running = 0;
+	/* Handle a send completion, caller holds io_cb_mutex
+	 *
+	 * Sends are retried by the kernel until complete, a short
+	 * send is a failure of the connection */
+
+	struct io_send *send = (struct io_send *)(uintptr_t)cqe->data;
+	struct connection *cx;
+
+	if ((cx = send->cx)) {
+
+		cx->send.inflight = NULL;
+
+		if ((cqe->res < 0 || (size_t)cqe->res < send->len)
+		 && (cx->st_cur == IO_ST_CXED || cx->st_cur == IO_ST_PING)) {
+			io_cb_error(cx->obj, "send failure: %s", strerror(cqe->res < 0 ? -cqe->res : EIO));
+			io_dx(cx);
+			io_cx(cx);
+		}
+	}
+
+	free(send->buf);
+	free(send);
 }
 
 static void
@@ -376,6 +924,15 @@ io_err(int err)
 static enum io_state
 io_state_rxng(struct connection *cx)
 {
+	/* Full jitter backoff, the delay is chosen uniformly from
+	 * [0, t(n)] so that connections dropped together don't retry
+	 * in lockstep. Any successful connection ends the delay early */
+
+	unsigned gen;
+	unsigned long delay;
+	unsigned long long t_end;
+	unsigned long long t_now;
+
 	if (cx->rx_sleep == 0) {
 		cx->rx_sleep = IO_RECONNECT_BACKOFF_BASE;
 	} else {
@@ -385,11 +942,42 @@ io_state_rxng(struct connection *cx)
 		);
 	}
 
-	io_info(cx, "Attemping reconnect in %02u:%02u",
-		(cx->rx_sleep / 60),
-		(cx->rx_sleep % 60));
+	delay = (unsigned long)(SEC_IN_MS((double)cx->rx_sleep) * rand_r(&(cx->rx_seed)) / RAND_MAX);
+
+	io_info(cx, "Attemping reconnect in %02lu:%02lu",
+		(delay / 1000 / 60),
+		(delay / 1000 % 60));
+
+	t_now = io_time_ms();
+	t_end = t_now + delay;
+
+	PT_LK(&io_rx_mutex);
+	gen = io_rx_gen;
+	io_rx_wait_add(cx);
+	PT_UL(&io_rx_mutex);
+
+	while (t_now < t_end && io_cx_poll(cx, -1, 0, t_end) == 0) {
+
+		int rx;
+
+		PT_LK(&io_rx_mutex);
+		rx = (gen != io_rx_gen);
+		PT_UL(&io_rx_mutex);
+
+		if (rx)
+			break;
+
+		t_now = io_time_ms();
+	}
+
+	PT_LK(&io_rx_mutex);
+
+	if (gen != io_rx_gen)
+		cx->rx_sleep = 0;
+
+	io_rx_wait_del(cx);
 
-	sleep(cx->rx_sleep);
+	PT_UL(&io_rx_mutex);
 
 	return IO_ST_CXNG;
 }
@@ -397,22 +985,57 @@ io_state_rxng(struct connection *cx)
 static enum io_state
 io_state_cxng(struct connection *cx)
 {
-	if ((io_net_connect(cx)) < 0)
-		return IO_ST_RXNG;
+	enum io_state st = IO_ST_CXED;
+
+	cx->read.len = 0;
+	cx->read.discard = 0;
 
-	if ((cx->flags & IO_TLS_ENABLED) && io_tls_establish(cx) < 0)
+	/* Only the partial line in slot[head] is
+	 * discarded, published lines are retained */
+
+	if (io_cx_slot_get(cx) < 0)
 		return IO_ST_RXNG;
 
-	return IO_ST_CXED;
+	if (cx->tp->connect(cx))
+		st = IO_ST_RXNG;
+
+	io_cx_slot_put();
+
+	return st;
 }
 
 static enum io_state
 io_state_cxed(struct connection *cx)
 {
+	/* Read until IO_PING_MIN seconds of silence, sending
+	 * a latency probe every IO_PROBE_INTERVAL seconds */
+
 	int ret;
+	unsigned long long t_now = io_time_ms();
+	unsigned long long t_ping = t_now + SEC_IN_MS(IO_PING_MIN);
+	unsigned long long t_probe = t_now + SEC_IN_MS(IO_PROBE_INTERVAL);
+
+	for (;;) {
+
+		unsigned long long t_next = t_ping;
+
+		if (IO_PROBE_INTERVAL)
+			t_next = MIN(t_next, t_probe);
+
+		ret = io_cx_read(cx, t_next);
+
+		t_now = io_time_ms();
+
+		if (ret > 0)
+			t_ping = t_now + SEC_IN_MS(IO_PING_MIN);
+		else if (ret != MBEDTLS_ERR_SSL_TIMEOUT || t_now >= t_ping)
+			break;
 
-	while ((ret = io_cx_read(cx, SEC_IN_MS(IO_PING_MIN))) > 0)
-		continue;
+		if (IO_PROBE_INTERVAL && t_now >= t_probe) {
+			io_probe(cx);
+			t_probe = t_now + SEC_IN_MS(IO_PROBE_INTERVAL);
+		}
+	}
 
 	if (ret == MBEDTLS_ERR_SSL_TIMEOUT)
 		return IO_ST_PING;
@@ -432,12 +1055,7 @@ io_state_cxed(struct connection *cx)
 			break;
 	}
 
-	mbedtls_net_free(&(cx->net_ctx));
-
-	if (cx->flags & IO_TLS_ENABLED) {
-		mbedtls_ssl_config_free(&(cx->tls_conf));
-		mbedtls_ssl_free(&(cx->tls_ctx));
-	}
+	cx->tp->close(cx);
 
 	return IO_ST_CXNG;
 }
@@ -450,7 +1068,7 @@ io_state_ping(struct connection *cx)
 	if (cx->ping >= IO_PING_MAX)
 		return IO_ST_CXNG;
 
-	if ((ret = io_cx_read(cx, SEC_IN_MS(IO_PING_REFRESH))) > 0)
+	if ((ret = io_cx_read(cx, io_time_ms() + SEC_IN_MS(IO_PING_REFRESH))) > 0)
 		return IO_ST_CXED;
 
 	if (ret == MBEDTLS_ERR_SSL_TIMEOUT)
@@ -471,12 +1089,7 @@ io_state_ping(struct connection *cx)
 			break;
 	}
 
-	mbedtls_net_free(&(cx->net_ctx));
-
-	if (cx->flags & IO_TLS_ENABLED) {
-		mbedtls_ssl_config_free(&(cx->tls_conf));
-		mbedtls_ssl_free(&(cx->tls_ctx));
-	}
+	cx->tp->close(cx);
 
 	return IO_ST_CXNG;
 }
@@ -486,16 +1099,11 @@ io_thread(void *arg)
 {
 	struct connection *cx = arg;
 
-	/* SIGUSR1 indicates to a thread that it should return
-	 * to the state machine and check for a new state */
-
-	sigset_t sigset;
-
-	PT_CF(sigaddset(&sigset, SIGUSR1));
-	PT_CF(pthread_sigmask(SIG_UNBLOCK, &sigset, NULL));
-
 	cx->st_cur = IO_ST_CXNG;
 
+	if (capture_dir && !cx->capture)
+		io_cx_capture_open(cx);
+
 	io_info(cx, "Connecting to %s:%s", cx->host, cx->port);
 
 	do {
@@ -548,6 +1156,10 @@ io_thread(void *arg)
 				io_info(cx, " .. Connection successful");
 				io_cxed(cx);
 				cx->rx_sleep = 0;
+				PT_LK(&io_rx_mutex);
+				io_rx_gen++;
+				io_rx_notify();
+				PT_UL(&io_rx_mutex);
 				break;
 			case ST_X(IO_ST_CXNG, IO_ST_RXNG): /* E */
 				io_error(cx, " .. Connection failed -- retrying");
@@ -571,50 +1183,509 @@ io_thread(void *arg)
 }
 
 static int
-io_cx_read(struct connection *cx, uint32_t timeout)
+io_cx_read(struct connection *cx, unsigned long long t_end)
 {
+	/* Read until the deadline t_end */
+
 	int ret;
-	struct pollfd fd[1];
-	unsigned char buf[1024];
+	size_t len = cx->read.len;
+	unsigned head = atomic_load_explicit(&(cx->read.head), memory_order_relaxed);
+	unsigned char *buf = (unsigned char *)cx->read.slot[head % IO_RECV_SLOTS].buf + len;
 
-	fd[0].fd = cx->net_ctx.MBEDTLS_PRIVATE(fd);
-	fd[0].events = POLLIN;
+	while ((ret = io_cx_poll(cx, cx->net_ctx.MBEDTLS_PRIVATE(fd), POLLIN, t_end)) == 0) {
+		if (io_time_ms() >= t_end)
+			return MBEDTLS_ERR_SSL_TIMEOUT;
+	}
 
-	while ((ret = poll(fd, 1, timeout)) < 0 && errno == EAGAIN)
-		continue;
+	if (ret < 0)
+		return MBEDTLS_ERR_SSL_WANT_READ;
 
-	if (ret == 0)
-		return MBEDTLS_ERR_SSL_TIMEOUT;
+	ret = cx->tp->recv(cx, buf, IO_RECV_SIZE - len);
 
-	if (ret < 0 && errno == EINTR)
+	if (ret > 0 && io_cx_frame(cx, (size_t)ret) < 0)
 		return MBEDTLS_ERR_SSL_WANT_READ;
 
-	if (ret < 0)
-		fatal("poll: %s", strerror(errno));
+	return ret;
+}
 
-	if (cx->flags & IO_TLS_ENABLED) {
-		ret = mbedtls_ssl_read(&(cx->tls_ctx), buf, sizeof(buf));
-	} else {
-		ret = mbedtls_net_recv(&(cx->net_ctx), buf, sizeof(buf));
-	}
+static int
+io_cx_frame(struct connection *cx, size_t n)
+{
+	/* Frame messages in place in the producer's receive slot
+	 *
+	 * All complete lines are published to the main thread as a single
+	 * chunk, only the partial line that follows them is moved to the
+	 * next slot to be completed by subsequent reads */
+
+	unsigned head = atomic_load_explicit(&(cx->read.head), memory_order_relaxed);
+	char *buf = cx->read.slot[head % IO_RECV_SLOTS].buf;
+	size_t len = cx->read.len + n;
+	size_t i = len;
+
+	if (cx->read.discard) {
+
+		char *p;
+
+		if (!(p = memchr(buf, '\n', len))) {
+			cx->read.len = 0;
+			return 0;
+		}
+
+		cx->read.discard = 0;
 
-	if (ret > 0) {
-		IO_CB(io_cb_read_soc((char *)buf, (size_t)ret,  cx->obj));
+		len -= (size_t)(p - buf) + 1;
+		memmove(buf, p + 1, len);
+		i = len;
+		n = len;
 	}
 
-	return ret;
-}
+	/* Only the new bytes can contain the last line terminator */
+	while (i > len - n && buf[i - 1] != '\n')
+		i--;
 
-static void
-io_fatal(const char *f, int errnum)
-{
-	char errbuf[512];
+	cx->read.len = len;
 
-	if (strerror_r(errnum, errbuf, sizeof(errbuf)) == 0) {
-		fatal("%s: (%d): %s", f, errnum, errbuf);
-	} else {
-		fatal("%s: (%d): (failed to get error message)", f, errnum);
+	if (i > len - n) {
+
+		if (cx->capture)
+			io_cx_capture(cx, CAPTURE_RECV, buf, i);
+
+		return io_cx_publish(cx, i);
 	}
+
+	if (len == IO_RECV_SIZE) {
+		io_error(cx, "message exceeds %d bytes, discarding", IO_RECV_SIZE);
+		cx->read.discard = 1;
+		cx->read.len = 0;
+	}
+
+	return 0;
+}
+
+static int
+io_cx_publish(struct connection *cx, size_t n)
+{
+	/* Publish the first n bytes of slot[head] and move the remainder
+	 * to the next slot, blocking while the ring is full. Returns
+	 * non-zero if the wait was interrupted by a new state */
+
+	unsigned head = atomic_load_explicit(&(cx->read.head), memory_order_relaxed);
+
+	if (head + 1 - atomic_load(&(cx->read.tail)) >= IO_RECV_SLOTS) {
+
+		int interrupted = 0;
+
+		atomic_store(&(cx->read.wait), 1);
+
+		PT_LK(&(cx->mtx));
+
+		while (head + 1 - atomic_load(&(cx->read.tail)) >= IO_RECV_SLOTS) {
+			if ((interrupted = (cx->st_new != IO_ST_INVALID)))
+				break;
+			PT_CF(pthread_cond_wait(&(cx->read.cnd), &(cx->mtx)));
+		}
+
+		PT_UL(&(cx->mtx));
+
+		atomic_store(&(cx->read.wait), 0);
+
+		if (interrupted)
+			return -1;
+	}
+
+	char *cur = cx->read.slot[(head + 0) % IO_RECV_SLOTS].buf;
+	char *nxt = cx->read.slot[(head + 1) % IO_RECV_SLOTS].buf;
+
+	cx->read.len -= n;
+	cx->read.slot[head % IO_RECV_SLOTS].len = n;
+	memcpy(nxt, cur + n, cx->read.len);
+
+	atomic_store_explicit(&(cx->read.head), head + 1, memory_order_release);
+
+	io_wake();
+
+	return 0;
+}
+
+static void
+io_cx_capture(struct connection *cx, enum capture_dir dir, const char *buf, size_t len)
+{
+	/* Capture each line of buf, without "\r\n" */
+
+	const char *end = buf + len;
+	const char *p;
+	struct capture_rec rec = { .ns = capture_ns(), .dir = dir };
+
+	for (; buf < end; buf = p + 1) {
+
+		if (!(p = memchr(buf, '\n', (size_t)(end - buf))))
+			p = end;
+
+		rec.line = (char *)buf;
+		rec.len = (size_t)(p - buf);
+
+		if (rec.len && buf[rec.len - 1] == '\r')
+			rec.len--;
+
+		(void) capture_write(cx->capture, &rec);
+	}
+}
+
+static void
+io_cx_capture_open(struct connection *cx)
+{
+	/* Open the capture file for a connection: <capture_dir>/<host>.<port>.cap
+	 *
+	 * Captures record PASS and AUTHENTICATE verbatim, and are readable
+	 * by the user only */
+
+	char buf[512];
+	char path[4096];
+	int fd;
+
+	if ((size_t)snprintf(path, sizeof(path), "%s/%s.%s.cap", capture_dir, cx->host, cx->port) >= sizeof(path)) {
+		io_error(cx, "Failed to open capture: path too long");
+		return;
+	}
+
+	for (char *p = path + strlen(capture_dir) + 1; *p; p++) {
+		if (*p == '/')
+			*p = '_';
+	}
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0) {
+		io_error(cx, "Failed to open capture '%s': %s", path, io_strerror(buf, sizeof(buf)));
+		return;
+	}
+
+	if (fchmod(fd, 0600) < 0 || !(cx->capture = fdopen(fd, "wb"))) {
+		io_error(cx, "Failed to open capture '%s': %s", path, io_strerror(buf, sizeof(buf)));
+		close(fd);
+		return;
+	}
+
+	if (capture_header_write(cx->capture)) {
+		io_error(cx, "Failed to write capture '%s'", path);
+		fclose(cx->capture);
+		cx->capture = NULL;
+		return;
+	}
+
+	io_info(cx, "Capturing to '%s'", path);
+}
+
+static int
+io_cx_send(struct connection *cx, const unsigned char *buf, size_t len)
+{
+	int ret;
+	size_t written = 0;
+
+	while (written < len) {
+
+		if ((ret = cx->tp->send(cx, buf + written, len - written)) >= 0) {
+			written += (size_t) ret;
+			continue;
+		}
+
+		switch (ret) {
+			case MBEDTLS_ERR_SSL_WANT_READ:
+			case MBEDTLS_ERR_SSL_WANT_WRITE:
+				continue;
+			default:
+				io_dx(cx);
+				io_cx(cx);
+				return IO_ERR_SSL_WRITE;
+		}
+	}
+
+	return IO_ERR_NONE;
+}
+
+static void
+io_cx_drain(struct connection *cx)
+{
+	/* Consume all published slots, caller holds io_cb_mutex */
+
+	unsigned head = atomic_load_explicit(&(cx->read.head), memory_order_acquire);
+	unsigned tail = atomic_load_explicit(&(cx->read.tail), memory_order_relaxed);
+
+	while (tail != head) {
+
+		io_cb_read_soc(
+			cx->read.slot[tail % IO_RECV_SLOTS].buf,
+			cx->read.slot[tail % IO_RECV_SLOTS].len,
+			cx->obj);
+
+		atomic_store(&(cx->read.tail), ++tail);
+
+		if (atomic_load(&(cx->read.wait))) {
+			PT_LK(&(cx->mtx));
+			PT_CF(pthread_cond_signal(&(cx->read.cnd)));
+			PT_UL(&(cx->mtx));
+		}
+	}
+}
+
+static int
+io_cx_poll(struct connection *cx, int fd, short events, unsigned long long t_end)
+{
+	/* Poll fd, if non-negative, and the connection's wakeup fd until
+	 * the deadline t_end, if non-zero, set on the main thread's timer
+	 * wheel. Returns 1 if fd is ready, 0 on deadline or wakeup, -1 if
+	 * a new state is set */
+
+	int ret;
+	int timeout = -1;
+	enum io_state st_new;
+	struct pollfd fds[2] = {
+		{ .fd = cx->wake_fd[0], .events = POLLIN },
+		{ .fd = fd,             .events = events },
+	};
+
+	if (t_end && t_end <= io_time_ms())
+		timeout = 0;
+	else if (t_end)
+		io_cx_timer(cx, t_end);
+
+	if ((ret = poll(fds, (fd < 0 ? 1 : 2), timeout)) < 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			fatal("poll: %s", strerror(errno));
+		return 0;
+	}
+
+	if (fds[0].revents) {
+
+		uint64_t buf[8];
+
+		while (read(cx->wake_fd[0], buf, sizeof(buf)) > 0)
+			continue;
+	}
+
+	PT_LK(&(cx->mtx));
+	st_new = cx->st_new;
+	PT_UL(&(cx->mtx));
+
+	if (st_new != IO_ST_INVALID)
+		return -1;
+
+	return (fd >= 0 && fds[1].revents);
+}
+
+static int
+io_cx_slot_get(struct connection *cx)
+{
+	/* Limit concurrent connection attempts to IO_CONNECT_MAX */
+
+	int ret = 0;
+
+	PT_LK(&io_rx_mutex);
+
+	io_rx_wait_add(cx);
+
+	while (io_cx_active >= IO_CONNECT_MAX) {
+
+		PT_UL(&io_rx_mutex);
+
+		ret = io_cx_poll(cx, -1, 0, 0);
+
+		PT_LK(&io_rx_mutex);
+
+		if (ret < 0)
+			break;
+	}
+
+	if (ret == 0)
+		io_cx_active++;
+
+	io_rx_wait_del(cx);
+
+	PT_UL(&io_rx_mutex);
+
+	return (ret < 0 ? -1 : 0);
+}
+
+static void
+io_cx_slot_put(void)
+{
+	PT_LK(&io_rx_mutex);
+	io_cx_active--;
+	io_rx_notify();
+	PT_UL(&io_rx_mutex);
+}
+
+static void
+io_cx_timer(struct connection *cx, unsigned long long t_end)
+{
+	/* Set the connection thread's deadline, waking the main
+	 * thread if earlier than the tick it awaits. A deadline
+	 * left set only results in a spurious wakeup */
+
+	int wake = 0;
+
+	PT_LK(&io_timer_mutex);
+
+	if (!timer_pending(&(cx->timer)) || cx->timer.expires != t_end) {
+
+		timer_add(&io_timers, &(cx->timer), t_end);
+
+		if (t_end < io_timer_wait) {
+			io_timer_wait = t_end;
+			wake = 1;
+		}
+	}
+
+	PT_UL(&io_timer_mutex);
+
+	if (wake)
+		io_wake();
+}
+
+static void
+io_cx_timer_cb(struct timer *t)
+{
+	/* Caller holds io_timer_mutex */
+
+	io_cx_wake(t->arg);
+}
+
+static void
+io_cx_wake(struct connection *cx)
+{
+	/* Wake the connection thread to check for a new state */
+
+	uint64_t n = 1;
+
+	/* EAGAIN: the thread is already pending a wakeup */
+
+	while (write(cx->wake_fd[1], &n, sizeof(n)) < 0 && errno != EAGAIN) {
+		if (errno != EINTR)
+			fatal("write: %s", strerror(errno));
+	}
+}
+
+static void
+io_cx_wake_init(struct connection *cx)
+{
+#ifdef __linux__
+	if ((cx->wake_fd[0] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+		fatal("eventfd: %s", strerror(errno));
+
+	cx->wake_fd[1] = cx->wake_fd[0];
+#else
+	if (pipe(cx->wake_fd) < 0)
+		fatal("pipe: %s", strerror(errno));
+
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(cx->wake_fd[i], F_SETFL, fcntl(cx->wake_fd[i], F_GETFL) | O_NONBLOCK) < 0)
+			fatal("fcntl: %s", strerror(errno));
+		if (fcntl(cx->wake_fd[i], F_SETFD, FD_CLOEXEC) < 0)
+			fatal("fcntl: %s", strerror(errno));
+	}
+#endif
+}
+
+static void
+io_rx_notify(void)
+{
+	/* Wake all waiting threads to recheck io_rx_mutex state,
+	 * caller holds io_rx_mutex */
+
+	for (struct connection *cx = io_rx_waiters; cx; cx = cx->rx_next)
+		io_cx_wake(cx);
+}
+
+static void
+io_rx_wait_add(struct connection *cx)
+{
+	/* Caller holds io_rx_mutex */
+
+	cx->rx_next = io_rx_waiters;
+	io_rx_waiters = cx;
+}
+
+static void
+io_rx_wait_del(struct connection *cx)
+{
+	/* Caller holds io_rx_mutex */
+
+	for (struct connection **c = &io_rx_waiters; *c; c = &(*c)->rx_next) {
+		if (*c == cx) {
+			*c = cx->rx_next;
+			break;
+		}
+	}
+}
+
+static void
+io_wake(void)
+{
+	/* Wake the main thread to drain published data */
+
+	if (!atomic_exchange(&io_wake_pending, 1)) {
+
+		uint64_t n = 1;
+
+		while (write(io_wake_fd[1], &n, sizeof(n)) < 0) {
+			if (errno != EINTR)
+				fatal("write: %s", strerror(errno));
+		}
+	}
+}
+
+static void
+io_wake_init(void)
+{
+#ifdef __linux__
+	if ((io_wake_fd[0] = eventfd(0, EFD_CLOEXEC)) < 0)
+		fatal("eventfd: %s", strerror(errno));
+
+	io_wake_fd[1] = io_wake_fd[0];
+#else
+	if (pipe(io_wake_fd) < 0)
+		fatal("pipe: %s", strerror(errno));
+#endif
+}
+
+static void
+io_fatal(const char *f, int errnum)
+{
+	char errbuf[512];
+
+	if (strerror_r(errnum, errbuf, sizeof(errbuf)) == 0) {
+		fatal("%s: (%d): %s", f, errnum, errbuf);
+	} else {
+		fatal("%s: (%d): (failed to get error message)", f, errnum);
+	}
+}
+
+static unsigned long long
+io_time_ms(void)
+{
+	struct timespec ts;
+
+	PT_CF(clock_gettime(CLOCK_MONOTONIC, &ts));
+
+	return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+}
+
+static int
+io_timer_run(void)
+{
+	/* Fire expired timers, returning the milliseconds until
+	 * the next tick of the wheel, or -1 if none are pending */
+
+	uint64_t next;
+	uint64_t now = io_time_ms();
+
+	PT_LK(&io_timer_mutex);
+	timer_run(&io_timers, now);
+	next = io_timer_wait = timer_next(&io_timers);
+	PT_UL(&io_timer_mutex);
+
+	if (next == TIMER_NONE)
+		return -1;
+
+	return (int) MIN(next - now, INT_MAX);
 }
 
 static void
@@ -636,8 +1707,11 @@ io_sig_init(void)
 	if (sigaction(SIGWINCH, &sa, NULL) < 0)
 		fatal("sigaction - SIGWINCH: %s", strerror(errno));
 
-	if (sigaction(SIGUSR1, &sa, NULL) < 0)
-		fatal("sigaction - SIGUSR1: %s", strerror(errno));
+	/* Writes to a closed peer fail with EPIPE */
+	sa.sa_handler = SIG_IGN;
+
+	if (sigaction(SIGPIPE, &sa, NULL) < 0)
+		fatal("sigaction - SIGPIPE: %s", strerror(errno));
 }
 
 static void
@@ -718,7 +1792,7 @@ io_net_connect(struct connection *cx)
 		if ((soc = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1)
 			continue;
 
-		if (connect(soc, p->ai_addr, p->ai_addrlen) == 0)
+		if (io_net_connect_soc(cx, soc, p->ai_addr, p->ai_addrlen) == 0)
 			break;
 
 		io_net_close(soc);
@@ -745,6 +1819,8 @@ io_net_connect(struct connection *cx)
 	if (inet_ntop(p->ai_family, addr, buf, sizeof(buf)))
 		io_info(cx, " .. Connected [%s]", buf);
 
+	io_net_tcp_opts(cx, soc);
+
 	ret = soc;
 
 err:
@@ -753,6 +1829,98 @@ err:
 	return (cx->net_ctx.MBEDTLS_PRIVATE(fd) = ret);
 }
 
+static int
+io_net_connect_soc(struct connection *cx, int soc, const struct sockaddr *addr, socklen_t len)
+{
+	/* Connect without blocking the connection thread from a new
+	 * state, returns non-zero with errno set on failure, EINTR if
+	 * interrupted */
+
+	int err;
+	int flags;
+	int ret;
+	socklen_t err_len = sizeof(err);
+
+	if ((flags = fcntl(soc, F_GETFL)) < 0 || fcntl(soc, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -1;
+
+	if (connect(soc, addr, len) < 0) {
+
+		if (errno != EINPROGRESS)
+			return -1;
+
+		while ((ret = io_cx_poll(cx, soc, POLLOUT, 0)) == 0)
+			continue;
+
+		if (ret < 0) {
+			errno = EINTR;
+			return -1;
+		}
+
+		if (getsockopt(soc, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0)
+			return -1;
+
+		if (err) {
+			errno = err;
+			return -1;
+		}
+	}
+
+	if (fcntl(soc, F_SETFL, flags) < 0)
+		return -1;
+
+	return 0;
+}
+
+static void
+io_net_tcp_opts(struct connection *cx, int soc)
+{
+	/* Failing to set an option is reported, the connection continues
+	 * with the system default */
+
+	struct io_tcp_opts tcp;
+
+	PT_LK(&(cx->mtx));
+	tcp = cx->tcp;
+	PT_UL(&(cx->mtx));
+
+	#define IO_NET_OPT(L, O, V) \
+		io_net_setsockopt(cx, soc, (L), (O), #O, (V))
+
+	IO_NET_OPT(IPPROTO_TCP, TCP_NODELAY, tcp.nodelay);
+	IO_NET_OPT(SOL_SOCKET, SO_KEEPALIVE, !!tcp.keepidle);
+
+	if (tcp.keepidle) {
+#if defined(TCP_KEEPIDLE)
+		IO_NET_OPT(IPPROTO_TCP, TCP_KEEPIDLE, tcp.keepidle);
+#elif defined(TCP_KEEPALIVE)
+		IO_NET_OPT(IPPROTO_TCP, TCP_KEEPALIVE, tcp.keepidle);
+#endif
+#ifdef TCP_KEEPINTVL
+		IO_NET_OPT(IPPROTO_TCP, TCP_KEEPINTVL, tcp.keepintvl);
+#endif
+#ifdef TCP_KEEPCNT
+		IO_NET_OPT(IPPROTO_TCP, TCP_KEEPCNT, tcp.keepcnt);
+#endif
+	}
+
+#ifdef TCP_USER_TIMEOUT
+	if (tcp.user_timeout)
+		IO_NET_OPT(IPPROTO_TCP, TCP_USER_TIMEOUT, SEC_IN_MS(tcp.user_timeout));
+#endif
+
+	#undef IO_NET_OPT
+}
+
+static void
+io_net_setsockopt(struct connection *cx, int soc, int level, int opt, const char *name, int val)
+{
+	char buf[512];
+
+	if (setsockopt(soc, level, opt, &val, sizeof(val)) < 0)
+		io_error(cx, " .. Failed to set %s: %s", name, io_strerror(buf, sizeof(buf)));
+}
+
 static void
 io_net_close(int soc)
 {
@@ -764,6 +1932,126 @@ io_net_close(int soc)
 	errno = errno_save;
 }
 
+static int
+io_soc_recv(struct connection *cx, unsigned char *buf, size_t len)
+{
+	return mbedtls_net_recv(&(cx->net_ctx), buf, len);
+}
+
+static int
+io_soc_send(struct connection *cx, const unsigned char *buf, size_t len)
+{
+	return mbedtls_net_send(&(cx->net_ctx), buf, len);
+}
+
+static void
+io_soc_close(struct connection *cx)
+{
+	mbedtls_net_free(&(cx->net_ctx));
+}
+
+static int
+io_tcp_connect(struct connection *cx)
+{
+	return (io_net_connect(cx) < 0);
+}
+
+static int
+io_tls_connect(struct connection *cx)
+{
+	return (io_net_connect(cx) < 0 || io_tls_establish(cx) < 0);
+}
+
+static int
+io_tls_recv(struct connection *cx, unsigned char *buf, size_t len)
+{
+#ifdef IO_KTLS
+	if (cx->ktls_rx)
+		return io_ktls_recv(cx, buf, len);
+#endif
+
+	return mbedtls_ssl_read(&(cx->tls_ctx), buf, len);
+}
+
+static int
+io_tls_send(struct connection *cx, const unsigned char *buf, size_t len)
+{
+	if (cx->ktls_tx)
+		return mbedtls_net_send(&(cx->net_ctx), buf, len);
+
+	return mbedtls_ssl_write(&(cx->tls_ctx), buf, len);
+}
+
+static void
+io_tls_close(struct connection *cx)
+{
+	mbedtls_net_free(&(cx->net_ctx));
+	mbedtls_ssl_free(&(cx->tls_ctx));
+}
+
+static int
+io_unix_connect(struct connection *cx)
+{
+	/* Connect to a unix domain socket, the host is its path */
+
+	char buf[512];
+	int soc;
+	size_t len = strlen(cx->host);
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (len >= sizeof(addr.sun_path)) {
+		io_error(cx, " .. Failed to connect: socket path too long");
+		return -1;
+	}
+
+	memcpy(addr.sun_path, cx->host, len + 1);
+
+	if ((soc = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		io_error(cx, " .. Failed to obtain socket: %s", io_strerror(buf, sizeof(buf)));
+		return -1;
+	}
+
+	if (io_net_connect_soc(cx, soc, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		io_error(cx, " .. Failed to connect: %s", io_strerror(buf, sizeof(buf)));
+		io_net_close(soc);
+		return -1;
+	}
+
+	io_info(cx, " .. Connected [%s]", cx->host);
+
+	cx->net_ctx.MBEDTLS_PRIVATE(fd) = soc;
+
+	return 0;
+}
+
+static int
+io_loop_connect(struct connection *cx)
+{
+	/* Connect to the in-process loopback server, which
+	 * takes ownership of the other end of a socket pair */
+
+	char buf[512];
+	int soc[2];
+
+	if (!io_loop_accept) {
+		io_error(cx, " .. Failed to connect: no loopback server");
+		return -1;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, soc) < 0) {
+		io_error(cx, " .. Failed to obtain socket: %s", io_strerror(buf, sizeof(buf)));
+		return -1;
+	}
+
+	io_loop_accept(soc[1], io_loop_arg);
+
+	io_info(cx, " .. Connected [loopback]");
+
+	cx->net_ctx.MBEDTLS_PRIVATE(fd) = soc[0];
+
+	return 0;
+}
+
 static const char*
 io_strerror(char *buf, size_t buflen)
 {
@@ -780,40 +2068,24 @@ io_tls_establish(struct connection *cx)
 
 	io_info(cx, " .. Establishing TLS connection");
 
-	mbedtls_ssl_init(&(cx->tls_ctx));
-	mbedtls_ssl_config_init(&(cx->tls_conf));
-
-	if ((ret = mbedtls_ssl_config_defaults(
-			&(cx->tls_conf),
-			MBEDTLS_SSL_IS_CLIENT,
-			MBEDTLS_SSL_TRANSPORT_STREAM,
-			MBEDTLS_SSL_PRESET_DEFAULT))) {
-		io_error(cx, " .. %s ", io_tls_err(ret));
-		goto err;
-	}
-
-	mbedtls_ssl_conf_max_version(
-			&(cx->tls_conf),
-			MBEDTLS_SSL_MAJOR_VERSION_3,
-			MBEDTLS_SSL_MINOR_VERSION_3);
+	cx->ktls_rx = 0;
+	cx->ktls_tx = 0;
 
-	mbedtls_ssl_conf_min_version(
-			&(cx->tls_conf),
-			MBEDTLS_SSL_MAJOR_VERSION_3,
-			MBEDTLS_SSL_MINOR_VERSION_3);
-
-	mbedtls_ssl_conf_rng(&(cx->tls_conf), mbedtls_ctr_drbg_random, &tls_ctr_drbg);
+	mbedtls_ssl_init(&(cx->tls_ctx));
 
-	if (cx->flags & IO_TLS_VRFY_DISABLED) {
-		mbedtls_ssl_conf_authmode(&(cx->tls_conf), MBEDTLS_SSL_VERIFY_NONE);
-	} else {
-		mbedtls_ssl_conf_ca_chain(&(cx->tls_conf), &tls_x509_crt, NULL);
+	if (cx->tls_conf != &tls_conf_vrfy_disabled) {
 
-		if (cx->flags & IO_TLS_VRFY_OPTIONAL)
-			mbedtls_ssl_conf_authmode(&(cx->tls_conf), MBEDTLS_SSL_VERIFY_OPTIONAL);
+		PT_LK(&tls_x509_mutex);
+		ret = io_tls_x509_load();
+		PT_UL(&tls_x509_mutex);
 
-		if (cx->flags & IO_TLS_VRFY_REQUIRED)
-			mbedtls_ssl_conf_authmode(&(cx->tls_conf), MBEDTLS_SSL_VERIFY_REQUIRED);
+		if (ret < 0) {
+			if (ca_cert_path && *ca_cert_path)
+				io_error(cx, " .. Failed to load ca cert: '%s': %s", ca_cert_path, io_tls_err(ret));
+			else
+				io_error(cx, " .. Failed to load ca cert: %s", io_tls_err(ret));
+			goto err;
+		}
 	}
 
 	if ((ret = mbedtls_net_set_block(&(cx->net_ctx)))) {
@@ -821,7 +2093,7 @@ io_tls_establish(struct connection *cx)
 		goto err;
 	}
 
-	if ((ret = mbedtls_ssl_setup(&(cx->tls_ctx), &(cx->tls_conf)))) {
+	if ((ret = mbedtls_ssl_setup(&(cx->tls_ctx), cx->tls_conf))) {
 		io_error(cx, " .. %s ", io_tls_err(ret));
 		goto err;
 	}
@@ -838,10 +2110,44 @@ io_tls_establish(struct connection *cx)
 		mbedtls_net_recv,
 		NULL);
 
+#ifdef IO_KTLS
+	cx->tls_keys.set = 0;
+	mbedtls_ssl_set_export_keys_cb(&(cx->tls_ctx), io_ktls_export_keys, cx);
+#endif
+
+	/* Offer the session from the previous connection, falls
+	 * back to a full handshake if the server declines it */
+	if (cx->tls_session_set && (ret = mbedtls_ssl_set_session(&(cx->tls_ctx), &(cx->tls_session)))) {
+		io_error(cx, " .. Failed to resume session: %s ", io_tls_err(ret));
+		cx->tls_session_set = 0;
+	}
+
+	/* The handshake is non-blocking, waiting on the
+	 * socket such that a new state interrupts it */
+
+	if ((ret = mbedtls_net_set_nonblock(&(cx->net_ctx)))) {
+		io_error(cx, " .. %s ", io_tls_err(ret));
+		goto err;
+	}
+
 	while ((ret = mbedtls_ssl_handshake(&(cx->tls_ctx)))) {
-		if (ret != MBEDTLS_ERR_SSL_WANT_READ
-		 && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+
+		short events;
+
+		if (ret == MBEDTLS_ERR_SSL_WANT_READ)
+			events = POLLIN;
+		else if (ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+			events = POLLOUT;
+		else
 			break;
+
+		if (io_cx_poll(cx, cx->net_ctx.MBEDTLS_PRIVATE(fd), events, 0) < 0)
+			goto err;
+	}
+
+	if (!ret && (ret = mbedtls_net_set_block(&(cx->net_ctx)))) {
+		io_error(cx, " .. %s ", io_tls_err(ret));
+		goto err;
 	}
 
 	if (ret && cx->flags & IO_TLS_VRFY_DISABLED) {
@@ -861,19 +2167,254 @@ io_tls_establish(struct connection *cx)
 	io_info(cx, " ..   - version:     %s", mbedtls_ssl_get_version(&(cx->tls_ctx)));
 	io_info(cx, " ..   - ciphersuite: %s", mbedtls_ssl_get_ciphersuite(&(cx->tls_ctx)));
 
+	io_tls_session_save(cx);
+
+#ifdef IO_KTLS
+	if (io_ktls_init(cx) == 0) {
+		io_info(cx, " ..   - kernel TLS:  rx/tx");
+	} else if (cx->ktls_tx) {
+		io_error(cx, " .. Kernel TLS receive offload failed, reconnecting without kernel TLS");
+		cx->ktls_off = 1;
+		goto err;
+	}
+#endif
+
 	return 0;
 
 err:
 
 	io_error(cx, " .. TLS connection failure");
 
-	mbedtls_ssl_config_free(&(cx->tls_conf));
+#ifdef IO_KTLS
+	mbedtls_platform_zeroize(&(cx->tls_keys), sizeof(cx->tls_keys));
+#endif
+
+	cx->ktls_rx = 0;
+	cx->ktls_tx = 0;
+
+	/* Don't offer a session that may have caused the failure */
+	cx->tls_session_set = 0;
+
 	mbedtls_ssl_free(&(cx->tls_ctx));
 	mbedtls_net_free(&(cx->net_ctx));
 
 	return -1;
 }
 
+#ifdef IO_KTLS
+static void
+io_ktls_export_keys(
+	void *arg,
+	mbedtls_ssl_key_export_type type,
+	const unsigned char *secret,
+	size_t secret_len,
+	const unsigned char client_random[32],
+	const unsigned char server_random[32],
+	mbedtls_tls_prf_types prf)
+{
+	/* Retain the TLS 1.2 master secret for deriving the key block */
+
+	struct connection *cx = arg;
+
+	if (type != MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET || secret_len != sizeof(cx->tls_keys.secret))
+		return;
+
+	memcpy(cx->tls_keys.secret, secret, secret_len);
+	memcpy(cx->tls_keys.random, server_random, 32);
+	memcpy(cx->tls_keys.random + 32, client_random, 32);
+
+	cx->tls_keys.prf = prf;
+	cx->tls_keys.set = 1;
+}
+
+static int
+io_ktls_init(struct connection *cx)
+{
+	/* Install the negotiated traffic keys in the kernel TLS module
+	 *
+	 * Supported for TLS 1.2 AES-GCM and ChaCha20-Poly1305 ciphersuites.
+	 * On completion of the handshake each direction has sent only its
+	 * Finished message under the new keys, so the next record sequence
+	 * number is 1 for both.
+	 *
+	 * Offload is all or nothing: mbedtls can't continue a connection
+	 * once either direction's record state is in the kernel. A failure
+	 * before transmit is offloaded leaves userspace TLS, a receive
+	 * failure after it leaves ktls_tx set and the connection must be
+	 * reestablished with kernel TLS disabled */
+
+	union {
+		struct tls_crypto_info info;
+		struct tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+		struct tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+		struct tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+	} crypto[2] = {0}; /* [0]: client write (tx), [1]: server write (rx) */
+
+	static const unsigned char rec_seq[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+	unsigned char kb[(2 * 32) + (2 * 12)];
+	int fd = cx->net_ctx.MBEDTLS_PRIVATE(fd);
+	int ret = -1;
+	size_t key_len;
+	size_t iv_len;
+	socklen_t opt_len;
+
+	if (cx->ktls_off || !cx->tls_keys.set)
+		goto out;
+
+	/* Records already buffered by mbedtls can't be handed to the kernel */
+	if (mbedtls_ssl_check_pending(&(cx->tls_ctx)))
+		goto out;
+
+	switch (mbedtls_ssl_get_ciphersuite_id(mbedtls_ssl_get_ciphersuite(&(cx->tls_ctx)))) {
+		case MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256:
+		case MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256:
+			crypto[0].info.cipher_type = TLS_CIPHER_AES_GCM_128;
+			key_len = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+			iv_len = TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+			opt_len = sizeof(crypto[0].aes_gcm_128);
+			break;
+		case MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384:
+		case MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384:
+			crypto[0].info.cipher_type = TLS_CIPHER_AES_GCM_256;
+			key_len = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+			iv_len = TLS_CIPHER_AES_GCM_256_SALT_SIZE;
+			opt_len = sizeof(crypto[0].aes_gcm_256);
+			break;
+		case MBEDTLS_TLS_ECDHE_ECDSA_WITH_CHACHA20_POLY1305_SHA256:
+		case MBEDTLS_TLS_ECDHE_RSA_WITH_CHACHA20_POLY1305_SHA256:
+			crypto[0].info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+			key_len = TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE;
+			iv_len = TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE;
+			opt_len = sizeof(crypto[0].chacha20_poly1305);
+			break;
+		default:
+			goto out;
+	}
+
+	/* RFC 5246, section 6.3, AEAD key block:
+	 *   client_write_key, server_write_key, client_write_IV, server_write_IV */
+	if (mbedtls_ssl_tls_prf(
+			cx->tls_keys.prf,
+			cx->tls_keys.secret,
+			sizeof(cx->tls_keys.secret),
+			"key expansion",
+			cx->tls_keys.random,
+			sizeof(cx->tls_keys.random),
+			kb,
+			(2 * key_len) + (2 * iv_len)))
+		goto out;
+
+	for (int i = 0; i < 2; i++) {
+
+		const unsigned char *key = kb + (i * key_len);
+		const unsigned char *iv = kb + (2 * key_len) + (i * iv_len);
+
+		crypto[i].info.version = TLS_1_2_VERSION;
+		crypto[i].info.cipher_type = crypto[0].info.cipher_type;
+
+		/* The explicit nonce of GCM records is the sequence number */
+		switch (crypto[i].info.cipher_type) {
+			case TLS_CIPHER_AES_GCM_128:
+				memcpy(crypto[i].aes_gcm_128.key, key, key_len);
+				memcpy(crypto[i].aes_gcm_128.salt, iv, iv_len);
+				memcpy(crypto[i].aes_gcm_128.iv, rec_seq, sizeof(rec_seq));
+				memcpy(crypto[i].aes_gcm_128.rec_seq, rec_seq, sizeof(rec_seq));
+				break;
+			case TLS_CIPHER_AES_GCM_256:
+				memcpy(crypto[i].aes_gcm_256.key, key, key_len);
+				memcpy(crypto[i].aes_gcm_256.salt, iv, iv_len);
+				memcpy(crypto[i].aes_gcm_256.iv, rec_seq, sizeof(rec_seq));
+				memcpy(crypto[i].aes_gcm_256.rec_seq, rec_seq, sizeof(rec_seq));
+				break;
+			case TLS_CIPHER_CHACHA20_POLY1305:
+				memcpy(crypto[i].chacha20_poly1305.key, key, key_len);
+				memcpy(crypto[i].chacha20_poly1305.iv, iv, iv_len);
+				memcpy(crypto[i].chacha20_poly1305.rec_seq, rec_seq, sizeof(rec_seq));
+				break;
+		}
+	}
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0)
+		goto out;
+
+	if (setsockopt(fd, SOL_TLS, TLS_TX, &crypto[0], opt_len) < 0)
+		goto out;
+
+	cx->ktls_tx = 1;
+
+	if (setsockopt(fd, SOL_TLS, TLS_RX, &crypto[1], opt_len) < 0)
+		goto out;
+
+	cx->ktls_rx = 1;
+
+	ret = 0;
+
+out:
+
+	mbedtls_platform_zeroize(crypto, sizeof(crypto));
+	mbedtls_platform_zeroize(kb, sizeof(kb));
+	mbedtls_platform_zeroize(&(cx->tls_keys), sizeof(cx->tls_keys));
+
+	return ret;
+}
+
+static int
+io_ktls_recv(struct connection *cx, unsigned char *buf, size_t len)
+{
+	/* Read decrypted application data from the kernel TLS socket,
+	 * non-application records are returned with their content type */
+
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	struct cmsghdr *cmsg;
+	struct iovec iov = { .iov_base = buf, .iov_len = len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = cbuf,
+		.msg_controllen = sizeof(cbuf),
+	};
+	ssize_t ret;
+
+	if ((ret = recvmsg(cx->net_ctx.MBEDTLS_PRIVATE(fd), &msg, 0)) < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return MBEDTLS_ERR_SSL_WANT_READ;
+		if (errno == ECONNRESET || errno == EPIPE)
+			return MBEDTLS_ERR_NET_CONN_RESET;
+		return MBEDTLS_ERR_NET_RECV_FAILED;
+	}
+
+	if ((cmsg = CMSG_FIRSTHDR(&msg))
+	 && cmsg->cmsg_level == SOL_TLS
+	 && cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+
+		switch (*CMSG_DATA(cmsg)) {
+			case 23: /* application_data */
+				break;
+			case 21: /* alert, description close_notify(0) */
+				if (ret == 2 && buf[1] == 0)
+					return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+				return MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE;
+			default:
+				return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+		}
+	}
+
+	return (int)ret;
+}
+#endif
+
+static void
+io_tls_session_save(struct connection *cx)
+{
+	/* Save the negotiated session (ticket or session ID) so that
+	 * reconnects can skip the full handshake */
+
+	mbedtls_ssl_session_free(&(cx->tls_session));
+	mbedtls_ssl_session_init(&(cx->tls_session));
+
+	cx->tls_session_set = !mbedtls_ssl_get_session(&(cx->tls_ctx), &(cx->tls_session));
+}
+
 static int
 io_tls_x509_vrfy(struct connection *cx)
 {
@@ -924,6 +2465,9 @@ io_tls_init(void)
 	mbedtls_ctr_drbg_init(&tls_ctr_drbg);
 	mbedtls_entropy_init(&tls_entropy);
 	mbedtls_x509_crt_init(&tls_x509_crt);
+	mbedtls_ssl_config_init(&tls_conf_vrfy_disabled);
+	mbedtls_ssl_config_init(&tls_conf_vrfy_optional);
+	mbedtls_ssl_config_init(&tls_conf_vrfy_required);
 
 	if (atexit(io_tls_term))
 		fatal("atexit");
@@ -937,20 +2481,86 @@ io_tls_init(void)
 		fatal("mbedtls_ctr_drbg_seed: %s", io_tls_err(ret));
 	}
 
-	if (ca_cert_path && *ca_cert_path) {
+	io_tls_conf_init(&tls_conf_vrfy_disabled, MBEDTLS_SSL_VERIFY_NONE);
+	io_tls_conf_init(&tls_conf_vrfy_optional, MBEDTLS_SSL_VERIFY_OPTIONAL);
+	io_tls_conf_init(&tls_conf_vrfy_required, MBEDTLS_SSL_VERIFY_REQUIRED);
+}
 
-		if ((ret = mbedtls_x509_crt_parse_file(&tls_x509_crt, ca_cert_path)) < 0)
-			fatal("mbedtls_x509_crt_parse_file: '%s': %s", ca_cert_path, io_tls_err(ret));
+static void
+io_tls_conf_init(mbedtls_ssl_config *conf, int authmode)
+{
+	/* Configurations are shared by all connections with the same
+	 * verification mode, and are not modified after io_init, other
+	 * than the CA chain set before any verifying handshake */
 
-	} else {
+	int ret;
+
+	if ((ret = mbedtls_ssl_config_defaults(
+			conf,
+			MBEDTLS_SSL_IS_CLIENT,
+			MBEDTLS_SSL_TRANSPORT_STREAM,
+			MBEDTLS_SSL_PRESET_DEFAULT))) {
+		fatal("mbedtls_ssl_config_defaults: %s", io_tls_err(ret));
+	}
+
+	mbedtls_ssl_conf_max_version(
+			conf,
+			MBEDTLS_SSL_MAJOR_VERSION_3,
+			MBEDTLS_SSL_MINOR_VERSION_3);
+
+	mbedtls_ssl_conf_min_version(
+			conf,
+			MBEDTLS_SSL_MAJOR_VERSION_3,
+			MBEDTLS_SSL_MINOR_VERSION_3);
+
+#ifdef MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+	/* Request records of at most MBEDTLS_SSL_OUT_CONTENT_LEN, servers
+	 * accepting the extension allow record buffers to be reduced to
+	 * that length after the handshake */
+	if ((ret = mbedtls_ssl_conf_max_frag_len(conf, MBEDTLS_SSL_MAX_FRAG_LEN_4096)))
+		fatal("mbedtls_ssl_conf_max_frag_len: %s", io_tls_err(ret));
+#endif
+
+	mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, &tls_ctr_drbg);
+	mbedtls_ssl_conf_authmode(conf, authmode);
+}
+
+static int
+io_tls_x509_load(void)
+{
+	/* Parsing the CA bundle is deferred until the first handshake
+	 * requiring peer verification, keeping it off the startup path.
+	 *
+	 * Called with tls_x509_mutex held. Success is cached, failure is
+	 * retried by the next handshake, e.g. once the bundle is installed */
 
+	int ret = MBEDTLS_ERR_X509_FILE_IO_ERROR;
+
+	if (tls_x509_loaded)
+		return 0;
+
+	if (ca_cert_path && *ca_cert_path) {
+		ret = mbedtls_x509_crt_parse_file(&tls_x509_crt, ca_cert_path);
+	} else {
 		for (size_t i = 0; i < ARR_LEN(ca_cert_paths); i++) {
 			if ((ret = mbedtls_x509_crt_parse_file(&tls_x509_crt, ca_cert_paths[i])) >= 0)
-				return;
+				break;
 		}
+	}
 
-		fatal("Failed to load ca cert: %s", io_tls_err(ret));
+	if (ret < 0) {
+		/* Discard any certs parsed before the failure */
+		mbedtls_x509_crt_free(&tls_x509_crt);
+		mbedtls_x509_crt_init(&tls_x509_crt);
+		return ret;
 	}
+
+	mbedtls_ssl_conf_ca_chain(&tls_conf_vrfy_optional, &tls_x509_crt, NULL);
+	mbedtls_ssl_conf_ca_chain(&tls_conf_vrfy_required, &tls_x509_crt, NULL);
+
+	tls_x509_loaded = 1;
+
+	return 0;
 }
 
 static void
@@ -961,4 +2571,7 @@ io_tls_term(void)
 	mbedtls_ctr_drbg_free(&tls_ctr_drbg);
 	mbedtls_entropy_free(&tls_entropy);
 	mbedtls_x509_crt_free(&tls_x509_crt);
+	mbedtls_ssl_config_free(&tls_conf_vrfy_disabled);
+	mbedtls_ssl_config_free(&tls_conf_vrfy_optional);
+	mbedtls_ssl_config_free(&tls_conf_vrfy_required);
 }
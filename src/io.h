@@ -55,19 +55,46 @@
  *   (H) on ping timeout update: io_cb_ping
  *   (I) on ping normal:         io_cb_ping
  *
+ * Connected sockets periodically result in a latency probe callback:
+ *   every IO_PROBE_INTERVAL:    io_cb_probe
+ *
  * Successful reads on stdin and connected sockets result in data callbacks:
  *   from stdin:  io_cb_read_inp
  *   from socket: io_cb_read_soc
  *
+ * Socket data is framed in a ring of per-connection receive buffers
+ * and passed to io_cb_read_soc in place as one or more complete '\n'
+ * terminated lines, which the callback may modify. Connection threads
+ * publish framed data to the main thread which drains all connections
+ * in batches; connection event callbacks are ordered after any data
+ * received before them
+ *
  * SIGWINCH results in a non signal-handler context callback io_cb_singwinch
  *
- * Failed connection attempts enter a retry cycle with exponential
- * backoff time given by:
+ * Failed connection attempts enter a retry cycle with full jitter
+ * exponential backoff, delaying uniformly in [0, t(n)], given by:
  *   t(n) = t(n - 1) * factor
  *   t(0) = base
  *
+ * A successful connection ends the backoff delay of all connections
+ * pending reconnect, and at most IO_CONNECT_MAX connection attempts
+ * are in progress at any time
+ *
+ * Connections use a transport selected by flags:
+ *   IO_LOOPBACK:    socket pair with an in-process server, see io_loopback
+ *   IO_UNIX:        unix domain socket, the host is the socket path
+ *   IO_TLS_ENABLED: TLS over TCP
+ *   otherwise:      TCP
+ *
+ * TCP sockets are set with keepalive and TCP_USER_TIMEOUT after connecting,
+ * such that the kernel detects a dead peer before the ping timeout
+ *
  * Calling io_start starts the io context and doesn't return until after
- * a call to io_stop
+ * a call to io_stop. When io_uring is enabled and supported by the kernel,
+ * stdin and wakeups are read by multishot requests, and lines written to
+ * connections while handling input or received data are submitted in a
+ * single batch, otherwise io_start falls back to poll. Connection sockets
+ * are never read by io_uring, only by connection threads
  */
 
 #include <stdarg.h>
@@ -82,9 +109,21 @@
 #define IO_TLS_VRFY_DISABLED (1 << 6)
 #define IO_TLS_VRFY_OPTIONAL (1 << 7)
 #define IO_TLS_VRFY_REQUIRED (1 << 8)
+#define IO_UNIX              (1 << 9)
+#define IO_LOOPBACK          (1 << 10)
 
 struct connection;
 
+/* TCP socket options, negative values leave the configured default */
+struct io_tcp_opts
+{
+	int nodelay;      /* TCP_NODELAY, [0, 1] */
+	int keepidle;     /* Seconds idle before keepalive probes, 0 disables keepalive */
+	int keepintvl;    /* Seconds between keepalive probes */
+	int keepcnt;      /* Unanswered keepalive probes before the connection is dropped */
+	int user_timeout; /* Seconds sent data may remain unacknowledged, 0 for the system default */
+};
+
 struct connection* connection(
 	const void*, /* callback object */
 	const char*, /* host */
@@ -93,6 +132,9 @@ struct connection* connection(
 
 void connection_free(struct connection*);
 
+/* Set TCP socket options, applied to subsequent connections */
+void connection_tcp_opts(struct connection*, const struct io_tcp_opts*);
+
 /* Explicit direction of net state */
 int io_cx(struct connection*);
 int io_dx(struct connection*);
@@ -111,6 +153,7 @@ void io_cb_read_soc(char*, size_t, const void*);
 void io_cb_cxed(const void*);
 void io_cb_dxed(const void*);
 void io_cb_ping(const void*, unsigned);
+void io_cb_probe(const void*);
 void io_cb_sigwinch(unsigned, unsigned);
 
 /* IO informational callbacks */
@@ -119,6 +162,12 @@ void io_cb_info(const void*, const char*, ...);
 
 void io_init(void);
 void io_start(void);
+
+/* Stop the io context, from any thread */
 void io_stop(void);
 
+/* Set the loopback server, passed the server end of each
+ * loopback connection from the connecting thread */
+void io_loopback(void (*)(int, void*), void*);
+
 #endif
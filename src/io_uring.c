@@ -0,0 +1,464 @@
+/* syscall(2), MAP_ANONYMOUS, MAP_POPULATE */
+#define _DEFAULT_SOURCE 1
+
+#include "src/io_uring.h"
+
+#include "src/utils/utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Provided buffer rings and multishot receive appear in the same headers */
+#if defined(__NR_io_uring_setup) && defined(IORING_RECV_MULTISHOT)
+#define URING_SUPPORTED
+#endif
+
+#endif
+
+#ifdef URING_SUPPORTED
+
+#define URING_BGID 0
+
+/* Opcode values are ABI, older headers lack multishot read (Linux 6.7) */
+#define URING_OP_READ_MULTISHOT 49
+
+#define URING_LOAD(P)     atomic_load_explicit((_Atomic unsigned *)(P), memory_order_acquire)
+#define URING_STORE(P, V) atomic_store_explicit((_Atomic unsigned *)(P), (V), memory_order_release)
+
+struct uring
+{
+	int fd;
+	struct {
+		unsigned *head;
+		unsigned *tail;
+		unsigned *array;
+		unsigned mask;
+		unsigned entries;
+		unsigned queued; /* entries queued since last submission */
+		struct io_uring_sqe *sqes;
+		size_t ring_len;
+		size_t sqes_len;
+		void *ring;
+	} sq;
+	struct {
+		unsigned *head;
+		unsigned *tail;
+		unsigned mask;
+		struct io_uring_cqe *cqes;
+		size_t ring_len;
+		void *ring;
+	} cq;
+	struct {
+		struct io_uring_buf_ring *ring;
+		char *bufs;
+		size_t ring_len;
+		size_t size;
+		unsigned n;
+		unsigned short tail;
+	} buf;
+};
+
+static int sys_io_uring_enter(int, unsigned, unsigned, unsigned, const void*, size_t);
+static int sys_io_uring_register(int, unsigned, void*, unsigned);
+static int sys_io_uring_setup(unsigned, struct io_uring_params*);
+static int uring_probe(int);
+static struct io_uring_sqe* uring_sqe(struct uring*);
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t argsz)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+	return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+struct uring*
+uring(unsigned entries, unsigned n_bufs, size_t buf_size)
+{
+	/* Create a ring with n_bufs provided buffers of buf_size bytes,
+	 * n_bufs must be a power of 2 */
+
+	struct io_uring_buf_reg reg = {0};
+	struct io_uring_params p = {0};
+	struct uring *u;
+
+	if (!n_bufs || (n_bufs & (n_bufs - 1)) || n_bufs > (1U << 15)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((u = calloc(1, sizeof(*u))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	u->cq.ring = MAP_FAILED;
+	u->sq.ring = MAP_FAILED;
+	u->sq.sqes = MAP_FAILED;
+	u->buf.ring = MAP_FAILED;
+
+	if ((u->fd = sys_io_uring_setup(entries, &p)) < 0)
+		goto err;
+
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP) || uring_probe(u->fd) < 0) {
+		errno = ENOSYS;
+		goto err;
+	}
+
+	u->sq.ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq.ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->sq.ring_len = MAX(u->sq.ring_len, u->cq.ring_len);
+	u->sq.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	u->sq.ring = mmap(NULL, u->sq.ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+
+	if (u->sq.ring == MAP_FAILED)
+		goto err;
+
+	u->sq.sqes = mmap(NULL, u->sq.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+
+	if (u->sq.sqes == MAP_FAILED)
+		goto err;
+
+	u->sq.head    = (unsigned *)((char *)u->sq.ring + p.sq_off.head);
+	u->sq.tail    = (unsigned *)((char *)u->sq.ring + p.sq_off.tail);
+	u->sq.array   = (unsigned *)((char *)u->sq.ring + p.sq_off.array);
+	u->sq.mask    = *(unsigned *)((char *)u->sq.ring + p.sq_off.ring_mask);
+	u->sq.entries = p.sq_entries;
+
+	u->cq.head = (unsigned *)((char *)u->sq.ring + p.cq_off.head);
+	u->cq.tail = (unsigned *)((char *)u->sq.ring + p.cq_off.tail);
+	u->cq.mask = *(unsigned *)((char *)u->sq.ring + p.cq_off.ring_mask);
+	u->cq.cqes = (struct io_uring_cqe *)((char *)u->sq.ring + p.cq_off.cqes);
+
+	/* Provided buffer ring */
+	u->buf.n = n_bufs;
+	u->buf.size = buf_size;
+	u->buf.ring_len = n_bufs * sizeof(struct io_uring_buf);
+	u->buf.ring = mmap(NULL, u->buf.ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (u->buf.ring == MAP_FAILED)
+		goto err;
+
+	if ((u->buf.bufs = malloc(n_bufs * buf_size)) == NULL)
+		fatal("malloc: %s", strerror(errno));
+
+	reg.ring_addr = (uint64_t)(uintptr_t)u->buf.ring;
+	reg.ring_entries = n_bufs;
+	reg.bgid = URING_BGID;
+
+	if (sys_io_uring_register(u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto err;
+
+	for (unsigned i = 0; i < n_bufs; i++)
+		uring_buf_put(u, i);
+
+	return u;
+
+err:
+
+	uring_free(u);
+
+	return NULL;
+}
+
+void
+uring_free(struct uring *u)
+{
+	int errno_save = errno;
+
+	if (u->buf.ring != MAP_FAILED)
+		munmap(u->buf.ring, u->buf.ring_len);
+
+	if (u->sq.sqes != MAP_FAILED)
+		munmap(u->sq.sqes, u->sq.sqes_len);
+
+	if (u->sq.ring != MAP_FAILED)
+		munmap(u->sq.ring, u->sq.ring_len);
+
+	if (u->fd >= 0)
+		close(u->fd);
+
+	free(u->buf.bufs);
+	free(u);
+
+	errno = errno_save;
+}
+
+int
+uring_read_multishot(struct uring *u, int fd, uint64_t data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = uring_sqe(u)) == NULL)
+		return -1;
+
+	sqe->opcode = URING_OP_READ_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->fd = fd;
+	sqe->buf_group = URING_BGID;
+	sqe->user_data = data;
+
+	return 0;
+}
+
+int
+uring_send(struct uring *u, int fd, const void *buf, size_t len, uint64_t data)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = uring_sqe(u)) == NULL)
+		return -1;
+
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)buf;
+	sqe->len = (uint32_t)len;
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+	sqe->user_data = data;
+
+	return 0;
+}
+
+int
+uring_submit(struct uring *u, unsigned n)
+{
+	int ret;
+	unsigned flags = (n ? IORING_ENTER_GETEVENTS : 0);
+
+	if ((ret = sys_io_uring_enter(u->fd, u->sq.queued, n, flags, NULL, 0)) < 0)
+		return -1;
+
+	u->sq.queued -= MIN((unsigned)ret, u->sq.queued);
+
+	return 0;
+}
+
+int
+uring_submit_timeout(struct uring *u, unsigned n, int timeout)
+{
+	/* Extended arguments predate multishot receive (Linux 5.11) */
+
+	int ret;
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg = {0};
+
+	if (!n || timeout < 0)
+		return uring_submit(u, n);
+
+	ts.tv_sec = timeout / 1000;
+	ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+
+	arg.ts = (uint64_t)(uintptr_t)&ts;
+
+	ret = sys_io_uring_enter(u->fd, u->sq.queued, n, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+	if (ret < 0)
+		return -1;
+
+	u->sq.queued -= MIN((unsigned)ret, u->sq.queued);
+
+	/* Submitting any requests returns their count on timeout */
+	if (URING_LOAD(u->cq.tail) - *(u->cq.head) < n) {
+		errno = ETIME;
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+uring_cqe_next(struct uring *u, struct uring_cqe *cqe)
+{
+	struct io_uring_cqe *c;
+	unsigned head = *(u->cq.head);
+
+	if (head == URING_LOAD(u->cq.tail))
+		return 0;
+
+	c = &(u->cq.cqes[head & u->cq.mask]);
+
+	cqe->buf = NULL;
+	cqe->bid = 0;
+	cqe->data = c->user_data;
+	cqe->res = c->res;
+	cqe->more = !!(c->flags & IORING_CQE_F_MORE);
+
+	if (c->flags & IORING_CQE_F_BUFFER) {
+		cqe->bid = c->flags >> IORING_CQE_BUFFER_SHIFT;
+		cqe->buf = u->buf.bufs + (cqe->bid * u->buf.size);
+	}
+
+	URING_STORE(u->cq.head, head + 1);
+
+	return 1;
+}
+
+void
+uring_buf_put(struct uring *u, unsigned bid)
+{
+	struct io_uring_buf *buf = &(u->buf.ring->bufs[u->buf.tail & (u->buf.n - 1)]);
+
+	buf->addr = (uint64_t)(uintptr_t)(u->buf.bufs + (bid * u->buf.size));
+	buf->len = (uint32_t)u->buf.size;
+	buf->bid = (uint16_t)bid;
+
+	u->buf.tail++;
+
+	atomic_store_explicit((_Atomic unsigned short *)&(u->buf.ring->tail), u->buf.tail, memory_order_release);
+}
+
+static int
+uring_probe(int fd)
+{
+	/* Check the kernel supports all required operations */
+
+	static const unsigned ops[] = {
+		URING_OP_READ_MULTISHOT,
+		IORING_OP_SEND,
+	};
+
+	int ret = 0;
+	struct io_uring_probe *probe;
+	size_t len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+
+	if ((probe = calloc(1, len)) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if (sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		ret = -1;
+	} else {
+		for (size_t i = 0; i < ARR_LEN(ops); i++) {
+			if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+				ret = -1;
+		}
+	}
+
+	free(probe);
+
+	return ret;
+}
+
+static struct io_uring_sqe*
+uring_sqe(struct uring *u)
+{
+	/* The kernel consumes entries only on submission,
+	 * so the tail is published before the entry is set */
+
+	struct io_uring_sqe *sqe;
+	unsigned tail = *(u->sq.tail);
+
+	if (tail - URING_LOAD(u->sq.head) >= u->sq.entries)
+		return NULL;
+
+	sqe = &(u->sq.sqes[tail & u->sq.mask]);
+	memset(sqe, 0, sizeof(*sqe));
+
+	u->sq.array[tail & u->sq.mask] = tail & u->sq.mask;
+	u->sq.queued++;
+
+	URING_STORE(u->sq.tail, tail + 1);
+
+	return sqe;
+}
+
+#else
+
+struct uring*
+uring(unsigned entries, unsigned n_bufs, size_t buf_size)
+{
+	UNUSED(entries);
+	UNUSED(n_bufs);
+	UNUSED(buf_size);
+
+	errno = ENOSYS;
+
+	return NULL;
+}
+
+void
+uring_free(struct uring *u)
+{
+	UNUSED(u);
+}
+
+int
+uring_read_multishot(struct uring *u, int fd, uint64_t data)
+{
+	UNUSED(u);
+	UNUSED(fd);
+	UNUSED(data);
+
+	return -1;
+}
+
+int
+uring_send(struct uring *u, int fd, const void *buf, size_t len, uint64_t data)
+{
+	UNUSED(u);
+	UNUSED(fd);
+	UNUSED(buf);
+	UNUSED(len);
+	UNUSED(data);
+
+	return -1;
+}
+
+int
+uring_submit(struct uring *u, unsigned n)
+{
+	UNUSED(u);
+	UNUSED(n);
+
+	errno = ENOSYS;
+
+	return -1;
+}
+
+int
+uring_submit_timeout(struct uring *u, unsigned n, int timeout)
+{
+	UNUSED(u);
+	UNUSED(n);
+	UNUSED(timeout);
+
+	errno = ENOSYS;
+
+	return -1;
+}
+
+int
+uring_cqe_next(struct uring *u, struct uring_cqe *cqe)
+{
+	UNUSED(u);
+	UNUSED(cqe);
+
+	return 0;
+}
+
+void
+uring_buf_put(struct uring *u, unsigned bid)
+{
+	UNUSED(u);
+	UNUSED(bid);
+}
+
+#endif
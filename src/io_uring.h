@@ -0,0 +1,50 @@
+#ifndef RIRC_IO_URING_H
+#define RIRC_IO_URING_H
+
+/* Minimal io_uring interface
+ *
+ * Wraps the io_uring system calls directly for a single submission and
+ * completion queue with one provided buffer ring, supporting multishot
+ * reads into provided buffers and sends from caller owned buffers.
+ * Sends are retried by the kernel until complete or failed.
+ *
+ * uring returns NULL on systems or kernels lacking the required
+ * features, i.e. provided buffer rings and multishot reads (Linux 6.7) */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct uring;
+
+struct uring_cqe
+{
+	char *buf;     /* provided buffer, if set */
+	uint64_t data; /* submission data */
+	int res;       /* result, or negative errno */
+	unsigned bid;  /* provided buffer id */
+	unsigned more : 1; /* multishot request remains armed */
+};
+
+struct uring* uring(unsigned, unsigned, size_t);
+void uring_free(struct uring*);
+
+/* Queue requests, returning non-zero if the submission queue is full */
+int uring_read_multishot(struct uring*, int, uint64_t);
+int uring_send(struct uring*, int, const void*, size_t, uint64_t);
+
+/* Submit queued requests and wait for at least n completions,
+ * returning non-zero with errno set on failure */
+int uring_submit(struct uring*, unsigned);
+
+/* As uring_submit, waiting at most timeout milliseconds, or indefinitely
+ * if negative. Returns non-zero with errno ETIME if fewer than n
+ * completions are available at the timeout */
+int uring_submit_timeout(struct uring*, unsigned, int);
+
+/* Get the next completion, returning zero if none */
+int uring_cqe_next(struct uring*, struct uring_cqe*);
+
+/* Return a provided buffer to the buffer ring */
+void uring_buf_put(struct uring*, unsigned);
+
+#endif
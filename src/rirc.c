@@ -24,6 +24,7 @@
 static const char* rirc_opt_str(char);
 static const char* rirc_pw_name(void);
 static int rirc_parse_args(int, char**);
+static int rirc_parse_num(const char*, char**, long, long, int*);
 
 #ifdef CA_CERT_PATH
 const char *ca_cert_path = CA_CERT_PATH;
@@ -31,6 +32,8 @@ const char *ca_cert_path = CA_CERT_PATH;
 const char *ca_cert_path;
 #endif
 
+const char *capture_dir;
+
 #ifdef DEFAULT_NICKS
 const char *default_nicks = DEFAULT_NICKS;
 #else
@@ -49,6 +52,12 @@ const char *default_realname = DEFAULT_REALNAME;
 const char *default_realname;
 #endif
 
+#ifdef IO_URING
+int io_uring_enabled = IO_URING;
+#else
+int io_uring_enabled;
+#endif
+
 #ifndef NDEBUG
 const char *runtime_name = "rirc.debug";
 #else
@@ -65,6 +74,10 @@ static const char *const rirc_help =
 "\n  -h, --help      Print help message and exit"
 "\n  -v, --version   Print rirc version and exit"
 "\n"
+"\nOptions:"
+"\n   --io-uring     Use io_uring for input and batched writes, if supported"
+"\n   --capture=DIR  Capture server traffic to DIR"
+"\n"
 "\nServer options:"
 "\n  -s, --server=SERVER       Connect to SERVER"
 "\n  -p, --port=PORT           Connect to SERVER using PORT"
@@ -79,6 +92,12 @@ static const char *const rirc_help =
 "\n   --ipv6                   Connect to server using only ipv6 addresses"
 "\n   --tls-disable            Set server TLS disabled"
 "\n   --tls-verify=<mode>      Set server TLS peer certificate verification mode"
+"\n   --unix                   Connect to server using SERVER as a unix socket path"
+"\n   --tcp-nodelay=<0|1>      Set server TCP_NODELAY"
+"\n   --tcp-keepalive=<idle[,interval[,count]]>"
+"\n                            Set server TCP keepalive, 0 to disable"
+"\n   --tcp-user-timeout=<sec> Set server TCP_USER_TIMEOUT, 0 for system default"
+"\n   --charset=<charset>      Set server fallback charset for text not valid UTF-8"
 "\n";
 
 static const char *const rirc_version =
@@ -101,8 +120,15 @@ rirc_opt_str(char c)
 		case 'r': return "-r/--realname";
 		case '4': return "--ipv4";
 		case '6': return "--ipv6";
+		case 'i': return "--io-uring";
+		case 'k': return "--capture";
 		case 'x': return "--tls-disable";
 		case 'y': return "--tls-verify";
+		case 'z': return "--unix";
+		case 'd': return "--tcp-nodelay";
+		case 'e': return "--tcp-keepalive";
+		case 't': return "--tcp-user-timeout";
+		case 'a': return "--charset";
 		default:
 			fatal("unknown option flag '%c'", c);
 	}
@@ -122,9 +148,29 @@ rirc_pw_name(void)
 	return passwd->pw_name;
 }
 
+static int
+rirc_parse_num(const char *str, char **end, long min, long max, int *num)
+{
+	/* Parse an integer in [min, max], returning non-zero on error */
+
+	long n;
+
+	errno = 0;
+
+	n = strtol(str, end, 10);
+
+	if (errno || *end == str || n < min || n > max)
+		return -1;
+
+	*num = (int)n;
+
+	return 0;
+}
+
 static int
 rirc_parse_args(int argc, char **argv)
 {
+	char *end;
 	int opt_c = 0;
 	int opt_i = 0;
 
@@ -141,23 +187,33 @@ rirc_parse_args(int argc, char **argv)
 		int ipv;
 		int tls;
 		int tls_vrfy;
+		int unix_soc;
+		enum charset charset;
+		struct io_tcp_opts tcp;
 		struct server *s;
 	} cli_servers[MAX_CLI_SERVERS];
 
 	struct option long_opts[] = {
-		{"server",      required_argument, 0, 's'},
-		{"port",        required_argument, 0, 'p'},
-		{"pass",        required_argument, 0, 'w'},
-		{"username",    required_argument, 0, 'u'},
-		{"realname",    required_argument, 0, 'r'},
-		{"nicks",       required_argument, 0, 'n'},
-		{"chans",       required_argument, 0, 'c'},
-		{"help",        no_argument,       0, 'h'},
-		{"version",     no_argument,       0, 'v'},
-		{"ipv4",        no_argument,       0, '4'},
-		{"ipv6",        no_argument,       0, '6'},
-		{"tls-disable", no_argument,       0, 'x'},
-		{"tls-verify",  required_argument, 0, 'y'},
+		{"server",           required_argument, 0, 's'},
+		{"port",             required_argument, 0, 'p'},
+		{"pass",             required_argument, 0, 'w'},
+		{"username",         required_argument, 0, 'u'},
+		{"realname",         required_argument, 0, 'r'},
+		{"nicks",            required_argument, 0, 'n'},
+		{"chans",            required_argument, 0, 'c'},
+		{"help",             no_argument,       0, 'h'},
+		{"version",          no_argument,       0, 'v'},
+		{"io-uring",         no_argument,       0, 'i'},
+		{"capture",          required_argument, 0, 'k'},
+		{"ipv4",             no_argument,       0, '4'},
+		{"ipv6",             no_argument,       0, '6'},
+		{"tls-disable",      no_argument,       0, 'x'},
+		{"tls-verify",       required_argument, 0, 'y'},
+		{"unix",             no_argument,       0, 'z'},
+		{"tcp-nodelay",      required_argument, 0, 'd'},
+		{"tcp-keepalive",    required_argument, 0, 'e'},
+		{"tcp-user-timeout", required_argument, 0, 't'},
+		{"charset",          required_argument, 0, 'a'},
 		{0, 0, 0, 0}
 	};
 
@@ -189,6 +245,9 @@ rirc_parse_args(int argc, char **argv)
 				cli_servers[n_servers - 1].ipv      = IO_IPV_UNSPEC;
 				cli_servers[n_servers - 1].tls      = IO_TLS_ENABLED;
 				cli_servers[n_servers - 1].tls_vrfy = IO_TLS_VRFY_REQUIRED;
+				cli_servers[n_servers - 1].unix_soc = 0;
+				cli_servers[n_servers - 1].charset  = CHARSET_UTF8;
+				cli_servers[n_servers - 1].tcp      = (struct io_tcp_opts) { -1, -1, -1, -1, -1 };
 				break;
 
 			#define CHECK_SERVER_OPTARG(OPT_C, REQ) \
@@ -263,8 +322,71 @@ rirc_parse_args(int argc, char **argv)
 				arg_error("invalid option for '--tls-verify' '%s'", optarg);
 				return -1;
 
+			case 'z': /* Connect using a unix domain socket */
+				CHECK_SERVER_OPTARG(opt_c, 0);
+				cli_servers[n_servers - 1].tls = IO_TLS_DISABLED;
+				cli_servers[n_servers - 1].unix_soc = IO_UNIX;
+				break;
+
+			case 'd': /* Set server TCP_NODELAY */
+				CHECK_SERVER_OPTARG(opt_c, 1);
+				if (rirc_parse_num(optarg, &end, 0, 1, &(cli_servers[n_servers - 1].tcp.nodelay)) || *end) {
+					arg_error("invalid option for '--tcp-nodelay' '%s'", optarg);
+					return -1;
+				}
+				break;
+
+			case 'e': /* Set server TCP keepalive idle[,interval[,count]] */
+				CHECK_SERVER_OPTARG(opt_c, 1);
+				end = optarg;
+				if (rirc_parse_num(end, &end, 0, 86400, &(cli_servers[n_servers - 1].tcp.keepidle))
+				 || (*end == ',' && rirc_parse_num(end + 1, &end, 1, 86400, &(cli_servers[n_servers - 1].tcp.keepintvl)))
+				 || (*end == ',' && rirc_parse_num(end + 1, &end, 1, 127, &(cli_servers[n_servers - 1].tcp.keepcnt)))
+				 || *end) {
+					arg_error("invalid option for '--tcp-keepalive' '%s'", optarg);
+					return -1;
+				}
+				break;
+
+			case 't': /* Set server TCP_USER_TIMEOUT */
+				CHECK_SERVER_OPTARG(opt_c, 1);
+				if (rirc_parse_num(optarg, &end, 0, 86400, &(cli_servers[n_servers - 1].tcp.user_timeout)) || *end) {
+					arg_error("invalid option for '--tcp-user-timeout' '%s'", optarg);
+					return -1;
+				}
+				break;
+
+			case 'a': /* Set server fallback charset */
+				CHECK_SERVER_OPTARG(opt_c, 1);
+				if (!strcmp(optarg, "utf-8") || !strcmp(optarg, "utf8")) {
+					cli_servers[n_servers - 1].charset = CHARSET_UTF8;
+					break;
+				}
+				if (!strcmp(optarg, "latin1") || !strcmp(optarg, "iso-8859-1")) {
+					cli_servers[n_servers - 1].charset = CHARSET_LATIN1;
+					break;
+				}
+				if (!strcmp(optarg, "cp1252") || !strcmp(optarg, "windows-1252")) {
+					cli_servers[n_servers - 1].charset = CHARSET_CP1252;
+					break;
+				}
+				arg_error("invalid option for '--charset' '%s'", optarg);
+				return -1;
+
 			#undef CHECK_SERVER_OPTARG
 
+			case 'i': /* Use io_uring when supported */
+				io_uring_enabled = 1;
+				break;
+
+			case 'k': /* Capture server traffic */
+				if (*optarg == '-') {
+					arg_error("option '%s' requires an argument", rirc_opt_str(opt_c));
+					return -1;
+				}
+				capture_dir = optarg;
+				break;
+
 			case 'h':
 				puts(rirc_help);
 				exit(EXIT_SUCCESS);
@@ -297,7 +419,8 @@ rirc_parse_args(int argc, char **argv)
 		uint32_t flags =
 			cli_servers[i].ipv |
 			cli_servers[i].tls |
-			cli_servers[i].tls_vrfy;
+			cli_servers[i].tls_vrfy |
+			cli_servers[i].unix_soc;
 
 		if (cli_servers[i].port == NULL)
 			cli_servers[i].port = (cli_servers[i].tls == IO_TLS_ENABLED) ? "6697" : "6667";
@@ -316,6 +439,10 @@ rirc_parse_args(int argc, char **argv)
 			cli_servers[i].port,
 			flags);
 
+		connection_tcp_opts(cli_servers[i].s->connection, &(cli_servers[i].tcp));
+
+		cli_servers[i].s->charset = cli_servers[i].charset;
+
 		if (server_list_add(state_server_list(), cli_servers[i].s)) {
 			arg_error("duplicate server: %s:%s", cli_servers[i].host, cli_servers[i].port);
 			return -1;
@@ -4,9 +4,11 @@
 /* Default config values obtained at runtime */
 
 extern const char *ca_cert_path;
+extern const char *capture_dir;
 extern const char *default_nick_set;
 extern const char *default_username;
 extern const char *default_realname;
 extern const char *runtime_name;
+extern int io_uring_enabled;
 
 #endif
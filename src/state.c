@@ -31,6 +31,7 @@ static uint16_t state_complete_user(char*, uint16_t, uint16_t, int);
 
 static void state_channel_clear(int);
 static void state_channel_close(int);
+static void state_server_lag(struct server*);
 
 static void channel_move_prev(void);
 static void channel_move_next(void);
@@ -89,7 +90,7 @@ static const char *irc_list[] = {
 
 /* List of rirc commands for tab completeion */
 static const char *cmd_list[] = {
-	"clear", "close", "connect", "disconnect", "quit", NULL};
+	"clear", "close", "connect", "disconnect", "lag", "quit", NULL};
 
 void
 state_init(void)
@@ -166,7 +167,7 @@ newlinef(struct channel *c, enum buffer_line_type type, const char *from, const
 static void
 _newline(struct channel *c, enum buffer_line_type type, const char *from, const char *fmt, va_list ap)
 {
-	char buf[TEXT_LENGTH_MAX];
+	char buf[TEXT_LENGTH_MAX + 1];
 	char prefix = 0;
 	const char *from_str;
 	const char *text_str;
@@ -181,7 +182,7 @@ _newline(struct channel *c, enum buffer_line_type type, const char *from, const
 		from_len = strlen(from_str);
 	} else {
 		text_str = buf;
-		text_len = len;
+		text_len = MIN((size_t)len, sizeof(buf) - 1);
 		from_str = from;
 
 		const struct user *u = NULL;
@@ -305,11 +306,45 @@ state_channel_clear(int action_confirm)
 	if (action_confirm) {
 		action(action_clear, "Clear buffer '%s'?   [y/n]", c->name);
 	} else {
-		memset(&(c->buffer), 0, sizeof(c->buffer));
+		buffer_free(&(c->buffer));
 		draw(DRAW_BUFFER);
 	}
 }
 
+static void
+state_server_lag(struct server *s)
+{
+	/* Print the server's latency histogram */
+
+	unsigned min = 0;
+
+	if (!s->lag.count) {
+		server_info(s, "lag: no samples");
+		return;
+	}
+
+	server_info(s, "lag: last %ums, p50 %ums, p90 %ums, p99 %ums (%u samples)",
+		s->lag.last,
+		server_lag_pct(s, 50),
+		server_lag_pct(s, 90),
+		server_lag_pct(s, 99),
+		s->lag.count);
+
+	for (unsigned i = 0; i < SERVER_LAG_BUCKETS; i++) {
+
+		unsigned max = server_lag_bucket_max(i);
+
+		if (s->lag.hist[i]) {
+			if (i == SERVER_LAG_BUCKETS - 1)
+				server_info(s, "  %6u+     ms : %u", min, s->lag.hist[i]);
+			else
+				server_info(s, "  %6u-%-6u ms : %u", min, max, s->lag.hist[i]);
+		}
+
+		min = max + 1;
+	}
+}
+
 static void
 state_channel_close(int action_confirm)
 {
@@ -648,6 +683,21 @@ command(struct channel *c, char *buf)
 		return;
 	}
 
+	if (!strcasecmp(cmd, "lag")) {
+		if (!c->server) {
+			action(action_error, "lag: This is not a server");
+			return;
+		}
+
+		if ((arg = irc_strsep(&buf))) {
+			action(action_error, "lag: Unknown arg '%s'", arg);
+			return;
+		}
+
+		state_server_lag(c->server);
+		return;
+	}
+
 	if (!strcasecmp(cmd, "quit")) {
 		if ((arg = irc_strsep(&buf))) {
 			action(action_error, "quit: Unknown arg '%s'", arg);
@@ -809,36 +859,44 @@ io_cb_read_inp(char *buf, size_t len)
 void
 io_cb_read_soc(char *buf, size_t len, const void *cb_obj)
 {
+	/* Parse and handle each line in place, buf holds one
+	 * or more complete lines, each terminated by '\n'. Lines
+	 * that aren't valid UTF-8 are transcoded from the server's
+	 * fallback charset. Lines of open IRCv3 batches are buffered
+	 * until the batch ends */
+
+	char *end = buf + len;
+	char *line;
+	size_t n;
 	struct server *s = (struct server *)cb_obj;
-	struct channel *c = s->channel;
-	size_t ci = s->read.i;
-	size_t n = len;
 
-	for (size_t i = 0; i < n; i++) {
+	while ((buf = irc_strline((line = buf), end, &n))) {
 
-		char cc = buf[i];
+		if (n == 0)
+			continue;
 
-		if (ci && cc == '\n' && ((i && buf[i - 1] == '\r') || (!i && s->read.cl == '\r'))) {
+		line[n] = 0;
 
-			s->read.buf[ci] = 0;
+		if (irc_utf8_valid(line, n) != n) {
 
-			debug_recv(ci, s->read.buf);
+			static char utf8[IRC_UTF8_SIZE(TEXT_LENGTH_MAX)];
 
-			struct irc_message m;
+			n = irc_strutf8(utf8, sizeof(utf8), line, n, s->charset);
+			line = utf8;
+		}
 
-			if (irc_message_parse(&m, s->read.buf) != 0)
-				newlinef(c, 0, FROM_ERROR, "failed to parse message");
-			else
-				irc_recv(s, &m);
+		debug_recv(n, line);
 
-			ci = 0;
-		} else if (ci < IRC_MESSAGE_LEN && (isprint(cc) || cc == 0x01)) {
-			s->read.buf[ci++] = cc;
-		}
-	}
+		if (irc_recv_batched(s, line, n))
+			continue;
 
-	s->read.cl = buf[n - 1];
-	s->read.i = ci;
+		struct irc_message m;
+
+		if (irc_message_parse(&m, line) != 0)
+			newlinef(s->channel, 0, FROM_ERROR, "failed to parse message");
+		else
+			irc_recv(s, &m);
+	}
 
 	draw(DRAW_FLUSH);
 }
@@ -903,6 +961,19 @@ io_cb_ping(const void *cb_obj, unsigned ping)
 	draw(DRAW_FLUSH);
 }
 
+void
+io_cb_probe(const void *cb_obj)
+{
+	int ret;
+	struct server *s = (struct server *)cb_obj;
+
+	if (!s->registered)
+		return;
+
+	if ((ret = io_sendf(s->connection, "PING :%s", server_lag_probe(s))))
+		newlinef(s->channel, 0, FROM_ERROR, "sendf fail: %s", io_err(ret));
+}
+
 void
 io_cb_sigwinch(unsigned cols, unsigned rows)
 {
@@ -0,0 +1,113 @@
+#include "src/utils/capture.h"
+
+#include <string.h>
+#include <time.h>
+
+#define CAPTURE_MAGIC   "RIRCCAP"
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_REC_HDR 11
+
+uint64_t
+capture_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+int
+capture_header_read(FILE *f)
+{
+	unsigned char hdr[sizeof(CAPTURE_MAGIC)];
+
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+		return -1;
+
+	if (memcmp(hdr, CAPTURE_MAGIC, sizeof(hdr) - 1))
+		return -1;
+
+	if (hdr[sizeof(hdr) - 1] != CAPTURE_VERSION)
+		return -1;
+
+	return 0;
+}
+
+int
+capture_header_write(FILE *f)
+{
+	unsigned char hdr[sizeof(CAPTURE_MAGIC)];
+
+	memcpy(hdr, CAPTURE_MAGIC, sizeof(hdr) - 1);
+
+	hdr[sizeof(hdr) - 1] = CAPTURE_VERSION;
+
+	if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+		return -1;
+
+	return 0;
+}
+
+int
+capture_write(FILE *f, const struct capture_rec *rec)
+{
+	int ret = 0;
+	size_t len = (rec->len > CAPTURE_LINE_MAX ? CAPTURE_LINE_MAX : rec->len);
+	unsigned char hdr[CAPTURE_REC_HDR];
+
+	for (int i = 0; i < 8; i++)
+		hdr[i] = (unsigned char)(rec->ns >> (i * 8));
+
+	hdr[8] = (unsigned char)rec->dir;
+	hdr[9] = (unsigned char)(len);
+	hdr[10] = (unsigned char)(len >> 8);
+
+	flockfile(f);
+
+	if (fwrite(hdr, 1, sizeof(hdr), f) != sizeof(hdr))
+		ret = -1;
+	else if (fwrite(rec->line, 1, len, f) != len)
+		ret = -1;
+
+	funlockfile(f);
+
+	return ret;
+}
+
+int
+capture_read(FILE *f, struct capture_rec *rec)
+{
+	size_t n;
+	unsigned char hdr[CAPTURE_REC_HDR];
+
+	if ((n = fread(hdr, 1, sizeof(hdr), f)) != sizeof(hdr))
+		return ((n == 0 && feof(f)) ? 0 : -1);
+
+	rec->ns = 0;
+
+	for (int i = 0; i < 8; i++)
+		rec->ns |= (uint64_t)hdr[i] << (i * 8);
+
+	switch (hdr[8]) {
+		case CAPTURE_RECV:
+			rec->dir = CAPTURE_RECV;
+			break;
+		case CAPTURE_SEND:
+			rec->dir = CAPTURE_SEND;
+			break;
+		default:
+			return -1;
+	}
+
+	rec->len = (size_t)hdr[9] | ((size_t)hdr[10] << 8);
+
+	if (fread(rec->line, 1, rec->len, f) != rec->len)
+		return -1;
+
+	rec->line[rec->len] = 0;
+
+	return 1;
+}
@@ -0,0 +1,49 @@
+#ifndef RIRC_UTILS_CAPTURE_H
+#define RIRC_UTILS_CAPTURE_H
+
+/* Traffic capture format
+ *
+ * A capture is a header followed by records of single lines,
+ * without their "\r\n", all integers are little endian:
+ *
+ *   header: "RIRCCAP" | version (u8)
+ *   record: time (u64, monotonic ns) | direction (u8) | length (u16) | line
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CAPTURE_LINE_MAX UINT16_MAX
+
+enum capture_dir
+{
+	CAPTURE_RECV,
+	CAPTURE_SEND,
+};
+
+struct capture_rec
+{
+	uint64_t ns;
+	enum capture_dir dir;
+	size_t len;
+	char *line;
+};
+
+/* Monotonic timestamp for records */
+uint64_t capture_ns(void);
+
+/* Returns non-zero on error */
+int capture_header_read(FILE*);
+int capture_header_write(FILE*);
+
+/* Write a record atomically with respect to other writers
+ * of the stream, lines are truncated to CAPTURE_LINE_MAX.
+ * Returns non-zero on error */
+int capture_write(FILE*, const struct capture_rec*);
+
+/* Read a record into line, which must hold CAPTURE_LINE_MAX + 1 bytes
+ * and is null terminated. Returns 1 on success, 0 at the end of the
+ * capture, -1 on error */
+int capture_read(FILE*, struct capture_rec*);
+
+#endif
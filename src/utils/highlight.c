@@ -0,0 +1,147 @@
+#include "src/utils/highlight.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGHLIGHT_DELTA(H, S, C) ((H)->delta[(size_t)(S) * (H)->n_classes + (C)])
+
+static void* highlight_calloc(size_t);
+
+static void*
+highlight_calloc(size_t n)
+{
+	void *ret;
+
+	if ((ret = calloc(n, sizeof(uint32_t))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	return ret;
+}
+
+void
+highlight_set(struct highlight *h, enum casemapping cm, const char **words, size_t n)
+{
+	/* Characters of the words are assigned classes once folded, all
+	 * other characters share class 0. The words are inserted as a trie
+	 * in the transition table, which is then completed breadth first
+	 * along the failure links, such that matching never backtracks */
+
+	size_t head = 0;
+	size_t tail = 0;
+	uint32_t *fail;
+	uint32_t *queue;
+	uint32_t next = 1;
+	unsigned char class[256] = {0};
+
+	highlight_free(h);
+
+	h->fold = irc_casemap(cm);
+	h->n_classes = 1;
+	h->n_states = 1;
+
+	for (size_t i = 0; i < n; i++) {
+		for (const unsigned char *p = (const unsigned char *)words[i]; *p; p++) {
+			if (!class[h->fold[*p]])
+				class[h->fold[*p]] = (unsigned char) h->n_classes++;
+			h->n_states++;
+		}
+	}
+
+	if (h->n_states == 1)
+		return;
+
+	for (unsigned c = 0; c < 256; c++)
+		h->class[c] = class[h->fold[c]];
+
+	h->delta = highlight_calloc((size_t)h->n_states * h->n_classes);
+	h->dict = highlight_calloc(h->n_states);
+	h->len = highlight_calloc(h->n_states);
+
+	fail = highlight_calloc(h->n_states);
+	queue = highlight_calloc(h->n_states);
+
+	for (size_t i = 0; i < n; i++) {
+
+		const unsigned char *p = (const unsigned char *)words[i];
+		uint32_t st = 0;
+
+		if (!*p)
+			continue;
+
+		for (; *p; p++) {
+			if (!HIGHLIGHT_DELTA(h, st, h->class[*p]))
+				HIGHLIGHT_DELTA(h, st, h->class[*p]) = next++;
+			st = HIGHLIGHT_DELTA(h, st, h->class[*p]);
+		}
+
+		h->len[st] = (uint32_t)(p - (const unsigned char *)words[i]);
+	}
+
+	for (unsigned c = 0; c < h->n_classes; c++) {
+		if (HIGHLIGHT_DELTA(h, 0, c))
+			queue[tail++] = HIGHLIGHT_DELTA(h, 0, c);
+	}
+
+	while (head < tail) {
+
+		uint32_t st = queue[head++];
+
+		h->dict[st] = (h->len[fail[st]] ? fail[st] : h->dict[fail[st]]);
+
+		for (unsigned c = 0; c < h->n_classes; c++) {
+
+			uint32_t *d = &HIGHLIGHT_DELTA(h, st, c);
+
+			if (*d) {
+				fail[*d] = HIGHLIGHT_DELTA(h, fail[st], c);
+				queue[tail++] = *d;
+			} else {
+				*d = HIGHLIGHT_DELTA(h, fail[st], c);
+			}
+		}
+	}
+
+	free(fail);
+	free(queue);
+}
+
+void
+highlight_free(struct highlight *h)
+{
+	free(h->delta);
+	free(h->dict);
+	free(h->len);
+
+	memset(h, 0, sizeof(*h));
+}
+
+int
+highlight_match(const struct highlight *h, const char *str)
+{
+	const unsigned char *p = (const unsigned char *)str;
+	uint32_t st = 0;
+
+	if (!h->delta)
+		return 0;
+
+	for (; *p; p++) {
+
+		st = HIGHLIGHT_DELTA(h, st, h->class[*p]);
+
+		for (uint32_t o = (h->len[st] ? st : h->dict[st]); o; o = h->dict[o]) {
+
+			const unsigned char *start = p + 1 - h->len[o];
+
+			if (start > (const unsigned char *)str && irc_isnickchar((char)start[-1], 0))
+				continue;
+
+			if (irc_isnickchar((char)p[1], 0))
+				continue;
+
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef RIRC_UTILS_HIGHLIGHT_H
+#define RIRC_UTILS_HIGHLIGHT_H
+
+/* Multi-pattern highlight matching
+ *
+ * A set of words is compiled into an Aho-Corasick automaton over
+ * characters folded by casemapping, with a full transition table over
+ * the classes of characters appearing in the set. Matching a message
+ * costs one table lookup per character, regardless of the number of
+ * words, plus a boundary check per word ending at each character.
+ *
+ * Words match only when not adjoined by nick characters, e.g. "nick"
+ * matches "nick: hi" and "@nick?", but not "nicks" or "xnick" */
+
+#include "src/utils/utils.h"
+
+#include <stdint.h>
+
+struct highlight
+{
+	const unsigned char *fold;
+	uint32_t *delta;          /* transitions, [state][class] */
+	uint32_t *dict;           /* next state along the failure links matching a word */
+	uint32_t *len;            /* length of the word matched at the state, or 0 */
+	unsigned char class[256]; /* class of each character, once folded */
+	unsigned n_classes;
+	unsigned n_states;
+};
+
+/* Compile a set of words, replacing any previous set. Empty words are ignored */
+void highlight_set(struct highlight*, enum casemapping, const char**, size_t);
+void highlight_free(struct highlight*);
+
+/* Return 1 if any word of the set is found in the message */
+int highlight_match(const struct highlight*, const char*);
+
+#endif
@@ -0,0 +1,229 @@
+#include "src/utils/timer.h"
+
+#include "src/utils/utils.h"
+
+#include <stddef.h>
+
+#define TIMER_MASK (TIMER_SLOTS - 1)
+
+/* Granularity of a level, and the range of the wheel */
+#define TIMER_SPAN(L) ((uint64_t)1 << (TIMER_BITS * (L)))
+
+static unsigned timer_ctz(uint64_t);
+static void timer_cascade(struct timer_wheel*, unsigned, unsigned);
+static void timer_fire(struct timer_wheel*, unsigned*);
+static void timer_link(struct timer_wheel*, struct timer*, uint64_t);
+static void timer_unlink(struct timer_wheel*, struct timer*);
+
+void
+timer_wheel_init(struct timer_wheel *w, uint64_t now)
+{
+	*w = (struct timer_wheel) { .now = now };
+}
+
+void
+timer_init(struct timer *t, void (*cb)(struct timer*), void *arg)
+{
+	*t = (struct timer) { .cb = cb, .arg = arg };
+}
+
+void
+timer_add(struct timer_wheel *w, struct timer *t, uint64_t expires)
+{
+	if (timer_pending(t))
+		timer_unlink(w, t);
+
+	t->expires = expires;
+
+	timer_link(w, t, MAX(expires, w->now + 1));
+}
+
+void
+timer_del(struct timer_wheel *w, struct timer *t)
+{
+	if (timer_pending(t))
+		timer_unlink(w, t);
+}
+
+int
+timer_pending(const struct timer *t)
+{
+	return (t->prev != NULL);
+}
+
+uint64_t
+timer_next(const struct timer_wheel *w)
+{
+	/* For each level, the next occupied slot after the current
+	 * tick's slot is processed at the start of its block */
+
+	uint64_t next = TIMER_NONE;
+
+	for (unsigned l = 0; l < TIMER_LEVELS; l++) {
+
+		uint64_t block;
+		uint64_t occupied;
+		unsigned start;
+
+		if (!(occupied = w->occupied[l]))
+			continue;
+
+		block = (w->now >> (TIMER_BITS * l)) + 1;
+		start = (unsigned)(block & TIMER_MASK);
+
+		if (start)
+			occupied = (occupied >> start) | (occupied << (TIMER_SLOTS - start));
+
+		block += timer_ctz(occupied);
+
+		if ((block << (TIMER_BITS * l)) < next)
+			next = block << (TIMER_BITS * l);
+	}
+
+	return next;
+}
+
+unsigned
+timer_run(struct timer_wheel *w, uint64_t now)
+{
+	uint64_t t;
+	unsigned fired = 0;
+
+	while ((t = timer_next(w)) <= now) {
+
+		w->now = t;
+
+		/* Cascade coarsest first, such that timers
+		 * due at this tick reach the finest level */
+
+		for (unsigned l = TIMER_LEVELS - 1; l > 0; l--) {
+			if (!(t & (TIMER_SPAN(l) - 1)))
+				timer_cascade(w, l, (unsigned)((t >> (TIMER_BITS * l)) & TIMER_MASK));
+		}
+
+		timer_fire(w, &fired);
+	}
+
+	if (now > w->now)
+		w->now = now;
+
+	return fired;
+}
+
+static unsigned
+timer_ctz(uint64_t n)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned) __builtin_ctzll(n);
+#else
+	unsigned i = 0;
+
+	while (!(n & 1)) {
+		n >>= 1;
+		i++;
+	}
+
+	return i;
+#endif
+}
+
+static void
+timer_cascade(struct timer_wheel *w, unsigned l, unsigned s)
+{
+	struct timer *t;
+	struct timer *list = w->slots[l][s];
+
+	w->slots[l][s] = NULL;
+	w->occupied[l] &= ~((uint64_t)1 << s);
+
+	while ((t = list)) {
+		list = t->next;
+		timer_link(w, t, t->expires);
+	}
+}
+
+static void
+timer_fire(struct timer_wheel *w, unsigned *fired)
+{
+	/* Fire the current tick's timers from a detached list,
+	 * callbacks may remove any of them before they fire */
+
+	struct timer *t;
+	struct timer *list;
+	unsigned s = (unsigned)(w->now & TIMER_MASK);
+
+	if (!(list = w->slots[0][s]))
+		return;
+
+	w->slots[0][s] = NULL;
+	w->occupied[0] &= ~((uint64_t)1 << s);
+
+	list->prev = &list;
+
+	while ((t = list)) {
+
+		if ((list = t->next))
+			list->prev = &list;
+
+		t->next = NULL;
+		t->prev = NULL;
+
+		t->cb(t);
+
+		(*fired)++;
+	}
+}
+
+static void
+timer_link(struct timer_wheel *w, struct timer *t, uint64_t expires)
+{
+	/* Place a timer at the finest level whose range includes its
+	 * expiry, timers beyond the range of the wheel are placed at
+	 * its limit and cascaded again. Cascaded timers due at the
+	 * current tick are placed in its slot, fired after cascading */
+
+	struct timer **head;
+	uint64_t delta;
+	unsigned l;
+	unsigned s;
+
+	delta = expires - w->now;
+
+	for (l = 0; l < TIMER_LEVELS - 1; l++) {
+		if (delta < TIMER_SPAN(l + 1))
+			break;
+	}
+
+	if (delta >= TIMER_SPAN(TIMER_LEVELS))
+		expires = w->now + TIMER_SPAN(TIMER_LEVELS) - 1;
+
+	s = (unsigned)((expires >> (TIMER_BITS * l)) & TIMER_MASK);
+
+	head = &(w->slots[l][s]);
+
+	if ((t->next = *head))
+		t->next->prev = &(t->next);
+
+	t->prev = head;
+	t->slot = l * TIMER_SLOTS + s;
+
+	*head = t;
+
+	w->occupied[l] |= ((uint64_t)1 << s);
+}
+
+static void
+timer_unlink(struct timer_wheel *w, struct timer *t)
+{
+	unsigned l = t->slot / TIMER_SLOTS;
+	unsigned s = t->slot % TIMER_SLOTS;
+
+	if ((*(t->prev) = t->next))
+		t->next->prev = t->prev;
+
+	t->next = NULL;
+	t->prev = NULL;
+
+	if (!w->slots[l][s])
+		w->occupied[l] &= ~((uint64_t)1 << s);
+}
@@ -0,0 +1,62 @@
+#ifndef RIRC_UTILS_TIMER_H
+#define RIRC_UTILS_TIMER_H
+
+/* Hierarchical timer wheel
+ *
+ * Timers are kept in TIMER_LEVELS wheels of TIMER_SLOTS slots, each
+ * level TIMER_SLOTS times coarser than the level below, and cascade
+ * into finer levels as they come due. Adding and removing a timer is
+ * O(1), as is finding the next tick at which the wheel must be run.
+ *
+ * Times are milliseconds of a caller provided monotonic clock. Timers
+ * beyond the range of the wheel are cascaded until they come due.
+ *
+ * The wheel is not thread safe */
+
+#include <stdint.h>
+
+#define TIMER_LEVELS 5
+#define TIMER_BITS   6
+#define TIMER_SLOTS  (1 << TIMER_BITS)
+
+#define TIMER_NONE UINT64_MAX
+
+struct timer
+{
+	struct timer *next;
+	struct timer **prev;
+	uint64_t expires;
+	void (*cb)(struct timer*);
+	void *arg;
+	unsigned slot; /* level and slot while pending */
+};
+
+struct timer_wheel
+{
+	struct timer *slots[TIMER_LEVELS][TIMER_SLOTS];
+	uint64_t occupied[TIMER_LEVELS];
+	uint64_t now;
+};
+
+void timer_wheel_init(struct timer_wheel*, uint64_t);
+
+/* Initialize a timer with its expiry callback */
+void timer_init(struct timer*, void (*)(struct timer*), void*);
+
+/* (Re)schedule a timer, timers already expired fire on the next tick */
+void timer_add(struct timer_wheel*, struct timer*, uint64_t);
+
+/* Cancel a timer, if pending */
+void timer_del(struct timer_wheel*, struct timer*);
+
+int timer_pending(const struct timer*);
+
+/* Return the next tick at which the wheel must be run, no later than
+ * the earliest expiry, or TIMER_NONE if no timers are pending */
+uint64_t timer_next(const struct timer_wheel*);
+
+/* Advance the wheel, firing all timers expired at the given time.
+ * Callbacks may add or remove any timer. Returns the number fired */
+unsigned timer_run(struct timer_wheel*, uint64_t);
+
+#endif
@@ -2,14 +2,69 @@
 
 #include <errno.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#else
+#define IRC_SWAR_ONES  (UINT64_MAX / 0xFF)
+#define IRC_SWAR_HIGHS (IRC_SWAR_ONES * 0x80)
+#endif
+
+/* RFC 2812, section 2.2
+ *
+ * Because of IRC's Scandinavian origin, the characters {}|^ are
+ * considered to be the lower case equivalents of the characters []\~,
+ * respectively. This is a critical issue when determining the
+ * equivalence of two nicknames or channel names.
+ *
+ * Characters are folded to upper case by table, per casemapping */
+
+#define IRC_FOLD_ASCII(C)   (((C) >= 'a' && (C) <= 'z') ? (C) - 0x20 : (C))
+#define IRC_FOLD_STRICT(C)  (((C) >= 'a' && (C) <= '}') ? (C) - 0x20 : (C))
+#define IRC_FOLD_RFC1459(C) (((C) == '^') ? '~' : IRC_FOLD_STRICT(C))
+
+#define IRC_FOLD_16(F, C) \
+	F((C) + 0x0), F((C) + 0x1), F((C) + 0x2), F((C) + 0x3), \
+	F((C) + 0x4), F((C) + 0x5), F((C) + 0x6), F((C) + 0x7), \
+	F((C) + 0x8), F((C) + 0x9), F((C) + 0xA), F((C) + 0xB), \
+	F((C) + 0xC), F((C) + 0xD), F((C) + 0xE), F((C) + 0xF)
+
+#define IRC_FOLD_256(F) { \
+	IRC_FOLD_16(F, 0x00), IRC_FOLD_16(F, 0x10), IRC_FOLD_16(F, 0x20), IRC_FOLD_16(F, 0x30), \
+	IRC_FOLD_16(F, 0x40), IRC_FOLD_16(F, 0x50), IRC_FOLD_16(F, 0x60), IRC_FOLD_16(F, 0x70), \
+	IRC_FOLD_16(F, 0x80), IRC_FOLD_16(F, 0x90), IRC_FOLD_16(F, 0xA0), IRC_FOLD_16(F, 0xB0), \
+	IRC_FOLD_16(F, 0xC0), IRC_FOLD_16(F, 0xD0), IRC_FOLD_16(F, 0xE0), IRC_FOLD_16(F, 0xF0) }
+
+/* Windows-1252 0x80 - 0x9F, undefined bytes are replaced with U+FFFD */
+static const uint16_t irc_cp1252[32] = {
+	0x20AC, 0xFFFD, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0xFFFD, 0x017D, 0xFFFD,
+	0xFFFD, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0xFFFD, 0x017E, 0x0178,
+};
+
+static const unsigned char irc_casemaps[][256] = {
+	[CASEMAPPING_ASCII]          = IRC_FOLD_256(IRC_FOLD_ASCII),
+	[CASEMAPPING_RFC1459]        = IRC_FOLD_256(IRC_FOLD_RFC1459),
+	[CASEMAPPING_STRICT_RFC1459] = IRC_FOLD_256(IRC_FOLD_STRICT),
+};
+
 static inline int irc_ischanchar(char, int);
-static inline int irc_isnickchar(char, int);
 static inline int irc_toupper(enum casemapping, int);
+static inline unsigned irc_ctz(unsigned);
+static inline size_t irc_utf8_len(const unsigned char*, const unsigned char*);
+#if defined(__SSE2__)
+static size_t irc_strcmp_block(enum casemapping, const unsigned char*, const unsigned char*, size_t);
+#endif
+static void irc_message_tag_add(struct irc_message*, char*, size_t, char*, size_t);
 
 int
 irc_isnick(const char *str)
@@ -39,38 +94,27 @@ irc_ischan(const char *str)
 	return 1;
 }
 
-int
-irc_pinged(enum casemapping cm, const char *mesg, const char *nick)
-{
-	size_t len = strlen(nick);
-
-	while (*mesg) {
-
-		while (*mesg && *mesg != *nick && !irc_isnickchar(*mesg, 1))
-			mesg++;
-
-		if (!irc_strncmp(cm, mesg, nick, len) && !irc_isnickchar(*(mesg + len), 0))
-			return 1;
-
-		while (*mesg && *mesg != ' ')
-			mesg++;
-	}
-
-	return 0;
-}
-
 int
 irc_strcmp(enum casemapping cm, const char *s1, const char *s2)
 {
 	/* Case insensitive comparison of strings s1, s2 in accordance
 	 * with RFC 2812, section 2.2 */
 
+	const unsigned char *fold = irc_casemap(cm);
+	const unsigned char *p1 = (const unsigned char *)s1;
+	const unsigned char *p2 = (const unsigned char *)s2;
 	int c1, c2;
 
+#if defined(__SSE2__)
+	size_t n = irc_strcmp_block(cm, p1, p2, SIZE_MAX);
+	p1 += n;
+	p2 += n;
+#endif
+
 	for (;;) {
 
-		c1 = irc_toupper(cm, *s1++);
-		c2 = irc_toupper(cm, *s2++);
+		c1 = fold[*p1++];
+		c2 = fold[*p2++];
 
 		if ((c1 -= c2))
 			return -c1;
@@ -88,12 +132,22 @@ irc_strncmp(enum casemapping cm, const char *s1, const char *s2, size_t n)
 	/* Case insensitive comparison of strings s1, s2 in accordance
 	 * with RFC 2812, section 2.2, up to n characters */
 
+	const unsigned char *fold = irc_casemap(cm);
+	const unsigned char *p1 = (const unsigned char *)s1;
+	const unsigned char *p2 = (const unsigned char *)s2;
 	int c1, c2;
 
+#if defined(__SSE2__)
+	size_t m = irc_strcmp_block(cm, p1, p2, n);
+	p1 += m;
+	p2 += m;
+	n -= m;
+#endif
+
 	while (n > 0) {
 
-		c1 = irc_toupper(cm, *s1++);
-		c2 = irc_toupper(cm, *s2++);
+		c1 = fold[*p1++];
+		c2 = fold[*p2++];
 
 		if ((c1 -= c2))
 			return -c1;
@@ -112,35 +166,19 @@ irc_strncmp(enum casemapping cm, const char *s1, const char *s2, size_t n)
 int
 irc_message_param(struct irc_message *m, char **param)
 {
-	*param = NULL;
+	unsigned i;
 
-	if (m->params == NULL)
+	if (m->n_params_read == m->n_params) {
+		*param = NULL;
 		return 0;
-
-	if (!irc_strtrim(&m->params))
-		return 0;
-
-	if (!m->split && m->n_params >= 14) {
-		*param = m->params;
-		m->params = NULL;
-		return 1;
-	}
-
-	if (*m->params == ':') {
-		*param = m->params + 1;
-		m->params = NULL;
-		return 1;
 	}
 
-	m->n_params++;
+	i = m->n_params_read++;
 
-	*param = m->params;
+	/* Terminate in case rejoined by irc_message_split */
+	m->params[i][m->len_params[i]] = 0;
 
-	while (*m->params && *m->params != ' ')
-		m->params++;
-
-	if (*m->params)
-		*m->params++ = 0;
+	*param = m->params[i];
 
 	return 1;
 }
@@ -163,13 +201,65 @@ irc_message_parse(struct irc_message *m, char *buf)
 	 *
 	 * SPACE      =   %x20        ; space character
 	 * crlf       =   %x0D %x0A   ; "carriage return" "linefeed"
+	 *
+	 * Params are split and terminated in place, the trailing param
+	 * is the remainder of buf after a ':' or the 14th middle param
 	 */
 
-	memset(m, 0, sizeof(*m));
+	memset(m, 0, offsetof(struct irc_message, params));
 
 	if (!irc_strtrim(&buf))
 		return -1;
 
+	if (*buf == '@') {
+
+		/* IRCv3 message tags, parsed in place:
+		 *
+		 * tags   =   "@" tag *( ";" tag ) SPACE
+		 * tag    =   key [ "=" value ]
+		 * key    =   [ "+" ] [ vendor "/" ] 1*( ALPHA / DIGIT / "-" )
+		 * value  =   *( %x01-09 / %x0B-0C / %x0E-1F / %x21-3A / %x3C-FF )
+		 *            ; escaped, see irc_message_tag_value
+		 */
+
+		char sep;
+
+		do {
+			char *key = ++buf;
+			char *val;
+			size_t len_key;
+			size_t len_val;
+
+			buf += strcspn(buf, "=; ");
+			len_key = (size_t)(buf - key);
+
+			if (*buf == '=') {
+				*buf++ = 0;
+				val = buf;
+				buf += strcspn(buf, "; ");
+			} else {
+				val = buf;
+			}
+
+			len_val = (size_t)(buf - val);
+
+			if ((sep = *buf))
+				*buf = 0;
+
+			if (len_key)
+				irc_message_tag_add(m, key, len_key, val, len_val);
+
+		} while (sep == ';');
+
+		if (sep != ' ')
+			return -1;
+
+		buf++;
+
+		if (!irc_strtrim(&buf))
+			return -1;
+	}
+
 	if (*buf == ':') {
 
 		/* Prefix:
@@ -217,72 +307,327 @@ irc_message_parse(struct irc_message *m, char *buf)
 	if (*buf == ' ')
 		*buf++ = 0;
 
-	if (irc_strtrim(&buf))
-		m->params = buf;
+	while (irc_strtrim(&buf)) {
+
+		char *param;
+
+		if (*buf == ':' || m->n_params == IRC_MESSAGE_PARAMS_MAX - 1) {
+
+			if (*buf == ':')
+				buf++;
+
+			m->params[m->n_params] = buf;
+			m->len_params[m->n_params] = strlen(buf);
+			m->n_params++;
+			m->trailing = 1;
+			break;
+		}
+
+		param = buf;
+
+		while (*buf && *buf != ' ')
+			buf++;
+
+		m->params[m->n_params] = param;
+		m->len_params[m->n_params] = (size_t)(buf - param);
+		m->n_params++;
+
+		if (*buf == ' ')
+			*buf++ = 0;
+	}
 
 	return 0;
 }
 
+const char*
+irc_message_tag(struct irc_message *m, const char *key)
+{
+	/* Duplicate keys take the final value */
+
+	for (unsigned i = m->n_tags; i > 0; i--) {
+		if (!strcmp(m->tags[i - 1].key, key))
+			return irc_message_tag_value(&(m->tags[i - 1]));
+	}
+
+	return NULL;
+}
+
+const char*
+irc_message_tag_key(struct irc_message *m, enum irc_message_tag_key key)
+{
+	if (!m->tag_keys[key])
+		return NULL;
+
+	return irc_message_tag_value(&(m->tags[m->tag_keys[key] - 1]));
+}
+
+const char*
+irc_message_tag_value(struct irc_message_tag *t)
+{
+	/* Unescape in place:
+	 *   "\:" -> ';'
+	 *   "\s" -> ' '
+	 *   "\\" -> '\'
+	 *   "\r" -> CR
+	 *   "\n" -> LF
+	 *   "\" followed by any other character is that character,
+	 *   a trailing "\" is dropped */
+
+	char *r = t->val;
+	char *w = t->val;
+
+	if (t->unescaped)
+		return t->val;
+
+	while (*r) {
+
+		if (*r != '\\') {
+			*w++ = *r++;
+			continue;
+		}
+
+		switch (*++r) {
+			case 0:
+				continue;
+			case ':':
+				*w++ = ';';
+				break;
+			case 's':
+				*w++ = ' ';
+				break;
+			case 'r':
+				*w++ = '\r';
+				break;
+			case 'n':
+				*w++ = '\n';
+				break;
+			default:
+				*w++ = *r;
+				break;
+		}
+
+		r++;
+	}
+
+	*w = 0;
+
+	t->len_val = (size_t)(w - t->val);
+	t->unescaped = 1;
+
+	return t->val;
+}
+
+static void
+irc_message_tag_add(struct irc_message *m, char *key, size_t len_key, char *val, size_t len_val)
+{
+	struct irc_message_tag *t;
+	int k = -1;
+
+	if (m->n_tags == IRC_MESSAGE_TAGS_MAX)
+		return;
+
+	t = &(m->tags[m->n_tags++]);
+	t->key = key;
+	t->val = val;
+	t->len_key = len_key;
+	t->len_val = len_val;
+	t->unescaped = 0;
+
+	switch (len_key) {
+		case 4:
+			if (!memcmp(key, "time", 4))
+				k = IRC_MESSAGE_TAG_TIME;
+			break;
+		case 5:
+			if (!memcmp(key, "batch", 5))
+				k = IRC_MESSAGE_TAG_BATCH;
+			else if (!memcmp(key, "label", 5))
+				k = IRC_MESSAGE_TAG_LABEL;
+			else if (!memcmp(key, "msgid", 5))
+				k = IRC_MESSAGE_TAG_MSGID;
+			break;
+		default:
+			break;
+	}
+
+	if (k >= 0)
+		m->tag_keys[k] = (unsigned char)m->n_tags;
+}
+
 int
-irc_message_split(struct irc_message *m, const char **params, const char **trailing)
+irc_message_split(struct irc_message *m, char **params, char **trailing)
 {
 	/* Split the message params and trailing arg for use in generic handling */
 
-	*params = m->params;
+	unsigned n_middle = m->n_params - m->trailing;
+
+	*params = NULL;
 	*trailing = NULL;
 
-	if (!m->params)
-		return 0;
+	if (m->n_params_read < n_middle) {
 
-	m->split = 1;
+		*params = m->params[m->n_params_read];
 
-	for (char *p = m->params; *p;) {
+		for (unsigned i = m->n_params_read; i < n_middle - 1; i++)
+			m->params[i][m->len_params[i]] = ' ';
+	}
 
-		while (*p == ' ')
-			p++;
+	if (m->trailing && m->n_params_read < m->n_params) {
 
-		if (*p == 0)
-			return 0;
+		if (*m->params[m->n_params - 1])
+			*trailing = m->params[m->n_params - 1];
 
-		m->n_params++;
+		return 1;
+	}
 
-		if (m->n_params >= 15) {
-			if (m->params == p) {
-				*params = m->params = NULL;
-				*trailing = p;
-			} else {
-				*trailing = (*p) ? p : NULL;
-				do {
-					if (p == m->params) {
-						*params = m->params = NULL;
-						return 1;
-					}
-					p--;
-				} while (*p == ' ');
-				*(p + 1) = 0;
+	return 0;
+}
+
+char*
+irc_strline(char *buf, const char *end, size_t *len)
+{
+	/* Filter the line at buf in place, retaining printable characters,
+	 * CTCP delimiters and bytes of multibyte characters, up to its
+	 * terminating '\n'. Any '\r' is filtered. Runs of retained bytes
+	 * are scanned and copied in blocks, the line terminator and filtered
+	 * bytes are handled singly. Multibyte characters are not validated,
+	 * see irc_strutf8.
+	 *
+	 * Returns a pointer past the '\n' and sets the filtered length,
+	 * or NULL if buf holds no line terminator */
+
+	char *r = buf;
+	char *w = buf;
+
+	while (r < end) {
+
+		size_t n = 0;
+
+#if defined(__AVX2__)
+		while (end - r >= 32) {
+
+			__m256i v = _mm256_loadu_si256((const __m256i *)r);
+			__m256i p = _mm256_andnot_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F)),
+				_mm256_cmpeq_epi8(v, _mm256_max_epu8(v, _mm256_set1_epi8(0x20))));
+			unsigned mask = ~(unsigned)_mm256_movemask_epi8(p);
+
+			if (mask) {
+				n = irc_ctz(mask);
+				break;
 			}
-			return 1;
+
+			if (w != r)
+				_mm256_storeu_si256((__m256i *)w, v);
+
+			r += 32;
+			w += 32;
 		}
+#elif defined(__SSE2__)
+		while (end - r >= 16) {
+
+			__m128i v = _mm_loadu_si128((const __m128i *)r);
+			__m128i p = _mm_andnot_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)),
+				_mm_cmpeq_epi8(v, _mm_max_epu8(v, _mm_set1_epi8(0x20))));
+			unsigned mask = ~(unsigned)_mm_movemask_epi8(p) & 0xFFFF;
+
+			if (mask) {
+				n = irc_ctz(mask);
+				break;
+			}
 
-		if (*p == ':') {
-			*p = 0;
-			*trailing = (*(p + 1)) ? (p + 1) : NULL;
-			do {
-				if (p == m->params) {
-					*params = m->params = NULL;
-					return 1;
-				}
-				p--;
-			} while (*p == ' ');
-			*(p + 1) = 0;
-			return 1;
+			if (w != r)
+				_mm_storeu_si128((__m128i *)w, v);
+
+			r += 16;
+			w += 16;
 		}
+#else
+		while (end - r >= 8) {
 
-		while (*p && *p != ' ')
-			p++;
+			uint64_t v;
+
+			memcpy(&v, r, sizeof(v));
+
+			uint64_t d = v ^ (IRC_SWAR_ONES * 0x7F);
+
+			/* Bytes less than 0x20 or equal to 0x7F */
+			if (((v - IRC_SWAR_ONES * 0x20) & ~v & IRC_SWAR_HIGHS)
+			 | ((d - IRC_SWAR_ONES) & ~d & IRC_SWAR_HIGHS))
+				break;
+
+			if (w != r)
+				memmove(w, r, sizeof(v));
+
+			r += 8;
+			w += 8;
+		}
+#endif
+
+		if (n) {
+			if (w != r)
+				memmove(w, r, n);
+			r += n;
+			w += n;
+		}
+
+		if (r == end)
+			break;
+
+		if (*r == '\n') {
+			*len = (size_t)(w - buf);
+			return r + 1;
+		}
+
+		if ((unsigned char)*r >= 0x20 && *r != 0x7F)
+			*w++ = *r;
+		else if (*r == 0x01)
+			*w++ = *r;
+
+		r++;
 	}
 
-	return 0;
+	return NULL;
+}
+
+char*
+irc_strlist(char **str, unsigned n, size_t len)
+{
+	/* Return the next prefix of a comma separated list, of at most n
+	 * elements (0: unlimited) and len bytes, or its first element if
+	 * longer. Returns NULL at the end of the list */
+
+	char *p;
+	char *ret;
+	unsigned count = 0;
+
+	if (str == NULL || (ret = p = *str) == NULL || *p == 0)
+		return NULL;
+
+	for (;;) {
+
+		char *end = p + strcspn(p, ",");
+
+		if (count && (size_t)(end - ret) > len) {
+			p[-1] = 0;
+			*str = p;
+			return ret;
+		}
+
+		if (*end == 0) {
+			*str = NULL;
+			return ret;
+		}
+
+		if (++count == n) {
+			*end = 0;
+			*str = end + 1;
+			return ret;
+		}
+
+		p = end + 1;
+	}
 }
 
 char*
@@ -326,6 +671,84 @@ irc_strtrim(char **str)
 	return *p ? p : NULL;
 }
 
+size_t
+irc_strutf8(char *dst, size_t size, const char *src, size_t len, enum charset cs)
+{
+	/* Invalid bytes are transcoded singly, valid runs between them
+	 * are found with irc_utf8_valid and copied whole. C1 controls are
+	 * replaced, whether encoded as UTF-8 or transcoded from a byte */
+
+	const char *end = src + len;
+	size_t n;
+	size_t w = 0;
+
+	if (size == 0)
+		return 0;
+
+	while (src < end) {
+
+		unsigned c;
+		unsigned cp;
+
+		n = irc_utf8_valid(src, (size_t)(end - src));
+
+		if (n > size - 1 - w) {
+
+			n = size - 1 - w;
+
+			while (n && (src[n] & 0xC0) == 0x80)
+				n--;
+
+			memcpy(dst + w, src, n);
+			w += n;
+			break;
+		}
+
+		memcpy(dst + w, src, n);
+		src += n;
+		w += n;
+
+		if (src == end)
+			break;
+
+		c = (unsigned char)*src;
+
+		if (c == 0xC2 && end - src > 1 && ((unsigned char)src[1] & 0xE0) == 0x80) {
+			cp = 0xFFFD;
+			src++;
+		} else switch (cs) {
+			case CHARSET_LATIN1:
+				cp = (c < 0xA0) ? 0xFFFD : c;
+				break;
+			case CHARSET_CP1252:
+				cp = (c < 0xA0) ? irc_cp1252[c - 0x80] : c;
+				break;
+			case CHARSET_UTF8:
+			default:
+				cp = 0xFFFD;
+		}
+
+		if (cp < 0x800) {
+			if (size - 1 - w < 2)
+				break;
+			dst[w++] = (char)(0xC0 | (cp >> 6));
+			dst[w++] = (char)(0x80 | (cp & 0x3F));
+		} else {
+			if (size - 1 - w < 3)
+				break;
+			dst[w++] = (char)(0xE0 | (cp >> 12));
+			dst[w++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+			dst[w++] = (char)(0x80 | (cp & 0x3F));
+		}
+
+		src++;
+	}
+
+	dst[w] = 0;
+
+	return w;
+}
+
 char*
 irc_strwrap(unsigned n, char **str, char *end)
 {
@@ -351,26 +774,36 @@ irc_strwrap(unsigned n, char **str, char *end)
 	 * where the whole string fits and str is advanced to the end and returned.
 	 *
 	 * The caller should check that (str != end) before subsequent calls
+	 *
+	 * Columns are counted by code point, the string is split only
+	 * between UTF-8 characters
 	 */
 
 	char *ret, *tmp;
+	unsigned cols = 0;
 
 	if (n < 1)
 		fatal("insufficient columns: %d", n);
 
+	/* Find the character following n columns */
+	for (ret = *str; ret < end; ret++) {
+		if (((unsigned char)*ret & 0xC0) != 0x80 && cols++ == n)
+			break;
+	}
+
 	/* All fits */
-	if ((end - *str) <= n)
+	if (ret == end)
 		return (*str = end);
 
 	/* Find last occuring ' ' character */
-	ret = (*str + n);
+	tmp = ret;
 
 	while (ret > *str && *ret != ' ')
 		ret--;
 
 	/* Nowhere to wrap */
 	if (ret == *str)
-		return (*str = ret + n);
+		return (*str = tmp);
 
 	/* Discard whitespace between wraps */
 	tmp = ret;
@@ -386,6 +819,75 @@ irc_strwrap(unsigned n, char **str, char *end)
 	return ret;
 }
 
+size_t
+irc_utf8_valid(const char *str, size_t len)
+{
+	/* Runs of ASCII are scanned in blocks, multibyte characters are
+	 * validated singly per RFC 3629, section 4 */
+
+	const unsigned char *p = (const unsigned char *)str;
+	const unsigned char *end = p + len;
+	size_t n;
+
+	while (p < end) {
+
+#if defined(__AVX2__)
+		while (end - p >= 32) {
+
+			unsigned mask = (unsigned)_mm256_movemask_epi8(
+				_mm256_loadu_si256((const __m256i *)p));
+
+			if (mask) {
+				p += irc_ctz(mask);
+				break;
+			}
+
+			p += 32;
+		}
+#elif defined(__SSE2__)
+		while (end - p >= 16) {
+
+			unsigned mask = (unsigned)_mm_movemask_epi8(
+				_mm_loadu_si128((const __m128i *)p));
+
+			if (mask) {
+				p += irc_ctz(mask);
+				break;
+			}
+
+			p += 16;
+		}
+#else
+		while (end - p >= 8) {
+
+			uint64_t v;
+
+			memcpy(&v, p, sizeof(v));
+
+			if (v & IRC_SWAR_HIGHS)
+				break;
+
+			p += 8;
+		}
+#endif
+
+		if (p == end)
+			break;
+
+		if (*p < 0x80) {
+			p++;
+			continue;
+		}
+
+		if (!(n = irc_utf8_len(p, end)))
+			break;
+
+		p += n;
+	}
+
+	return (size_t)(p - (const unsigned char *)str);
+}
+
 static inline int
 irc_ischanchar(char c, int first)
 {
@@ -416,7 +918,7 @@ irc_ischanchar(char c, int first)
 	}
 }
 
-static inline int
+int
 irc_isnickchar(char c, int first)
 {
 	/* RFC 2812, section 2.3.1
@@ -433,25 +935,132 @@ irc_isnickchar(char c, int first)
 static inline int
 irc_toupper(enum casemapping cm, int c)
 {
-	/* RFC 2812, section 2.2
-	 *
-	 * Because of IRC's Scandinavian origin, the characters {}|^ are
-	 * considered to be the lower case equivalents of the characters []\~,
-	 * respectively. This is a critical issue when determining the
-	 * equivalence of two nicknames or channel names. */
+	return irc_casemap(cm)[(unsigned char)c];
+}
 
+const unsigned char*
+irc_casemap(enum casemapping cm)
+{
 	switch (cm) {
+		case CASEMAPPING_ASCII:
 		case CASEMAPPING_RFC1459:
-			if (c == '^') return '~';
-			/* FALLTHROUGH */
 		case CASEMAPPING_STRICT_RFC1459:
-			if (c == '{') return '[';
-			if (c == '}') return ']';
-			if (c == '|') return '\\';
-			/* FALLTHROUGH */
-		case CASEMAPPING_ASCII:
-			return (c >= 'a' && c <= 'z') ? (c + 'A' - 'a') : c;
+			return irc_casemaps[cm];
 		default:
 			fatal("Unknown CASEMAPPING");
 	}
 }
+
+#if defined(__SSE2__)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((no_sanitize_address))
+#endif
+static size_t
+irc_strcmp_block(enum casemapping cm, const unsigned char *p1, const unsigned char *p2, size_t n)
+{
+	/* Fold and compare s1, s2 16 bytes at a time, returning the length
+	 * of their common folded prefix, stopping at a terminating NUL or n,
+	 * or at any block that can't be loaded.
+	 * Blocks are only loaded when neither crosses a page boundary, a
+	 * block may read past a terminating NUL but never into the next page */
+
+	const __m128i a = _mm_set1_epi8('a' - 1);
+	const __m128i z = _mm_set1_epi8((cm == CASEMAPPING_ASCII ? 'z' : '}') + 1);
+	const __m128i caret = _mm_set1_epi8('^');
+	const __m128i diff = _mm_set1_epi8(0x20);
+	const __m128i diff_caret = _mm_set1_epi8((cm == CASEMAPPING_RFC1459 ? 0x20 : 0));
+	const __m128i zero = _mm_setzero_si128();
+	size_t len = 0;
+
+	while (n - len >= 16
+	    && ((uintptr_t)(p1 + len) & 4095) <= 4096 - 16
+	    && ((uintptr_t)(p2 + len) & 4095) <= 4096 - 16) {
+
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(p1 + len));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)(p2 + len));
+		__m128i f1;
+		__m128i f2;
+		unsigned mask;
+
+		/* Lower case ranges fold down, '^' folds up */
+		f1 = _mm_and_si128(_mm_cmpgt_epi8(v1, a), _mm_cmplt_epi8(v1, z));
+		f2 = _mm_and_si128(_mm_cmpgt_epi8(v2, a), _mm_cmplt_epi8(v2, z));
+		f1 = _mm_sub_epi8(v1, _mm_and_si128(f1, diff));
+		f2 = _mm_sub_epi8(v2, _mm_and_si128(f2, diff));
+		f1 = _mm_add_epi8(f1, _mm_and_si128(_mm_cmpeq_epi8(v1, caret), diff_caret));
+		f2 = _mm_add_epi8(f2, _mm_and_si128(_mm_cmpeq_epi8(v2, caret), diff_caret));
+
+		mask = (unsigned)_mm_movemask_epi8(
+			_mm_or_si128(
+				_mm_cmpeq_epi8(v1, zero),
+				_mm_xor_si128(_mm_cmpeq_epi8(f1, f2), _mm_set1_epi8(-1))));
+
+		if (mask)
+			return len + irc_ctz(mask);
+
+		len += 16;
+	}
+
+	return len;
+}
+#endif
+
+static inline unsigned
+irc_ctz(unsigned n)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned) __builtin_ctz(n);
+#else
+	unsigned i = 0;
+
+	while (!(n & 1)) {
+		n >>= 1;
+		i++;
+	}
+
+	return i;
+#endif
+}
+
+static inline size_t
+irc_utf8_len(const unsigned char *p, const unsigned char *end)
+{
+	/* Return the length of the valid multibyte character at p, or 0.
+	 * Overlong forms, surrogates and code points above U+10FFFF are
+	 * invalid, as are characters truncated by end, and C1 controls
+	 * (U+0080 - U+009F) which aren't to be passed to the terminal */
+
+	unsigned char lo = 0x80;
+	unsigned char hi = 0xBF;
+	size_t n;
+
+	if (*p >= 0xC2 && *p <= 0xDF) {
+		n = 2;
+		if (*p == 0xC2)
+			lo = 0xA0;
+	} else if (*p >= 0xE0 && *p <= 0xEF) {
+		n = 3;
+		if (*p == 0xE0)
+			lo = 0xA0;
+		if (*p == 0xED)
+			hi = 0x9F;
+	} else if (*p >= 0xF0 && *p <= 0xF4) {
+		n = 4;
+		if (*p == 0xF0)
+			lo = 0x90;
+		if (*p == 0xF4)
+			hi = 0x8F;
+	} else {
+		return 0;
+	}
+
+	if ((size_t)(end - p) < n || p[1] < lo || p[1] > hi)
+		return 0;
+
+	for (size_t i = 2; i < n; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return 0;
+	}
+
+	return n;
+}
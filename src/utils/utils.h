@@ -51,9 +51,47 @@ enum casemapping
 	CASEMAPPING_STRICT_RFC1459
 };
 
+/* Charset of received text that isn't valid UTF-8 */
+enum charset
+{
+	CHARSET_UTF8, /* replaced with U+FFFD */
+	CHARSET_LATIN1,
+	CHARSET_CP1252
+};
+
+/* Buffer size sufficient to transcode N bytes with irc_strutf8 */
+#define IRC_UTF8_SIZE(N) ((N) * 3 + 1)
+
+/* RFC 2812, section 2.3, excluding CRLF */
+#define IRC_MESSAGE_LEN 510
+
+/* RFC 2812, section 2.3.1: 14 middle params and a trailing param */
+#define IRC_MESSAGE_PARAMS_MAX 15
+
+/* Tags parsed per message, further tags are ignored */
+#define IRC_MESSAGE_TAGS_MAX 16
+
+/* Tags with constant time lookup */
+enum irc_message_tag_key
+{
+	IRC_MESSAGE_TAG_BATCH,
+	IRC_MESSAGE_TAG_LABEL,
+	IRC_MESSAGE_TAG_MSGID,
+	IRC_MESSAGE_TAG_TIME,
+	IRC_MESSAGE_TAG_SIZE
+};
+
+struct irc_message_tag
+{
+	const char *key; /* including any client prefix and vendor */
+	char *val;       /* escaped in place until unescaped on access */
+	size_t len_key;
+	size_t len_val;
+	unsigned unescaped : 1;
+};
+
 struct irc_message
 {
-	char *params;
 	const char *command;
 	const char *from;
 	const char *host;
@@ -61,20 +99,51 @@ struct irc_message
 	size_t len_from;
 	size_t len_host;
 	unsigned n_params;
-	unsigned split : 1;
+	unsigned n_params_read; /* by irc_message_param */
+	unsigned n_tags;
+	unsigned char tag_keys[IRC_MESSAGE_TAG_SIZE]; /* tag index + 1, or 0 */
+	unsigned trailing : 1;  /* final param is trailing */
+	/* Not cleared by irc_message_parse beyond n_params, n_tags */
+	char *params[IRC_MESSAGE_PARAMS_MAX];
+	size_t len_params[IRC_MESSAGE_PARAMS_MAX];
+	struct irc_message_tag tags[IRC_MESSAGE_TAGS_MAX];
 };
 
+/* Return the table folding characters by casemapping */
+const unsigned char* irc_casemap(enum casemapping);
+
 int irc_ischan(const char*);
 int irc_isnick(const char*);
-int irc_pinged(enum casemapping, const char*, const char*);
+int irc_isnickchar(char, int);
 int irc_strcmp(enum casemapping, const char*, const char*);
 int irc_strncmp(enum casemapping, const char*, const char*, size_t);
+char* irc_strline(char*, const char*, size_t*);
+char* irc_strlist(char**, unsigned, size_t);
 char* irc_strsep(char**);
 char* irc_strtrim(char**);
 char* irc_strwrap(unsigned, char**, char*);
 
+/* Return the length of the longest valid UTF-8 prefix */
+size_t irc_utf8_valid(const char*, size_t);
+
+/* Copy as UTF-8, passing valid UTF-8 through and transcoding other
+ * bytes from a fallback charset. Writes at most size - 1 bytes and a
+ * null terminator, truncating at a character. Returns the length */
+size_t irc_strutf8(char*, size_t, const char*, size_t, enum charset);
+
+/* Return the next unread param, from params in constant time. Handlers
+ * read params in order through this, rather than indexing params */
 int irc_message_param(struct irc_message*, char**);
 int irc_message_parse(struct irc_message*, char*);
-int irc_message_split(struct irc_message*, const char**, const char**);
+
+/* Return the unread middle params, rejoined as received, and
+ * the trailing param if unread. Returns 1 if trailing is unread */
+int irc_message_split(struct irc_message*, char**, char**);
+
+/* Message tag values, unescaped on access, valueless tags are "".
+ * Return NULL if the tag isn't present */
+const char* irc_message_tag(struct irc_message*, const char*);
+const char* irc_message_tag_key(struct irc_message*, enum irc_message_tag_key);
+const char* irc_message_tag_value(struct irc_message_tag*);
 
 #endif
@@ -63,6 +63,8 @@ test_buffer_head(void)
 
 	assert_strcmp(buffer_head(&b)->text, _fmt_int(BUFFER_LINES_MAX + 1));
 	assert_eq(buffer_size(&b), BUFFER_LINES_MAX);
+
+	buffer_free(&b);
 }
 
 static void
@@ -87,6 +89,8 @@ test_buffer_tail(void)
 
 	assert_strcmp(buffer_tail(&b)->text, _fmt_int(2));
 	assert_eq(buffer_size(&b), BUFFER_LINES_MAX);
+
+	buffer_free(&b);
 }
 
 static void
@@ -220,6 +224,8 @@ test_buffer_scrollback(void)
 
 	_buffer_newline(&b, "f");
 	assert_strcmp(buffer_line(&b, b.scrollback)->text, "c");
+
+	buffer_free(&b);
 }
 
 static void
@@ -272,54 +278,44 @@ test_buffer_index_overflow(void)
 
 	assert_eq(buffer_size(&b), 3);
 	assert_strcmp(b.buffer_lines[0].text, _fmt_int(-1));
+
+	buffer_free(&b);
 }
 
 static void
 test_buffer_line_overlength(void)
 {
-	/* Test that lines over the maximum length are recursively split and added separately */
+	/* Test that long lines are stored whole, and lines over
+	 * the maximum length are truncated to a single line */
 
 	struct buffer b;
 
 	buffer(&b);
 
-	/* Indices to first and last positions of lines, total length = 2.5 times the maximum */
-	unsigned f1 = 0,
-	         l1 = TEXT_LENGTH_MAX - 1,
-	         f2 = TEXT_LENGTH_MAX,
-	         l2 = TEXT_LENGTH_MAX * 2 - 1,
-	         f3 = TEXT_LENGTH_MAX * 2,
-	         l3 = TEXT_LENGTH_MAX * 2 + TEXT_LENGTH_MAX / 2 - 1;
-
-	/* Add a line that's 2.5 times the maximum length */
-	char text[(l3 + 1) + 1];
+	char text[TEXT_LENGTH_MAX * 2 + 1];
 
 	memset(&text, ' ', sizeof(text) - 1);
 
-	text[f1] = 'a';
-	text[l1] = 'A';
-	text[f2] = 'b';
-	text[l2] = 'B';
-	text[f3] = 'c';
-	text[l3] = 'C';
-
+	text[0] = 'a';
+	text[TEXT_LENGTH_MAX - 1] = 'A';
+	text[TEXT_LENGTH_MAX] = 'b';
 	text[sizeof(text) - 1] = 0;
 
-	_buffer_newline(&b, text);
+	_buffer_newline(&b, text + TEXT_LENGTH_MAX);
 
+	assert_eq(buffer_size(&b), 1);
 	assert_ueq(b.buffer_lines[0].text_len, TEXT_LENGTH_MAX);
-	assert_ueq(b.buffer_lines[2].text_len, TEXT_LENGTH_MAX / 2);
-
-	assert_eq(buffer_size(&b), 3);
+	assert_eq(b.buffer_lines[0].text[0], 'b');
 
-	assert_eq(b.buffer_lines[0].text[0], 'a');
-	assert_eq(b.buffer_lines[0].text[TEXT_LENGTH_MAX - 1], 'A');
+	_buffer_newline(&b, text);
 
-	assert_eq(b.buffer_lines[1].text[0], 'b');
-	assert_eq(b.buffer_lines[1].text[TEXT_LENGTH_MAX - 1], 'B');
+	assert_eq(buffer_size(&b), 2);
+	assert_ueq(b.buffer_lines[1].text_len, TEXT_LENGTH_MAX);
+	assert_eq(b.buffer_lines[1].text[0], 'a');
+	assert_eq(b.buffer_lines[1].text[TEXT_LENGTH_MAX - 1], 'A');
+	assert_eq(b.buffer_lines[1].text[TEXT_LENGTH_MAX], 0);
 
-	assert_eq(b.buffer_lines[2].text[0], 'c');
-	assert_eq(b.buffer_lines[2].text[TEXT_LENGTH_MAX / 2 - 1], 'C');
+	buffer_free(&b);
 }
 
 static void
@@ -360,6 +356,8 @@ test_buffer_line_rows(void)
 	_buffer_newline(&b, "");
 
 	assert_eq(buffer_line_rows(buffer_head(&b), 1), 1);
+
+	buffer_free(&b);
 }
 
 static void
@@ -431,6 +429,8 @@ test_buffer_newline_prefix(void)
 	line = buffer_head(&b);
 	assert_ueq(line->from_len, FROM_LENGTH_MAX);
 	assert_eq(line->from[FROM_LENGTH_MAX - 1], 'b');
+
+	buffer_free(&b);
 }
 
 int
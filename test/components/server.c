@@ -6,6 +6,7 @@
 #include "src/components/mode.c"
 #include "src/components/server.c"
 #include "src/components/user.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 void
@@ -294,6 +295,137 @@ test_parse_005(void)
 #undef CHECK
 }
 
+static void
+test_server_lag(void)
+{
+	struct server *s = server("host", "port", NULL, "user", "real");
+
+	/* bucket bounds */
+	assert_eq(server_lag_bucket(0),  0);
+	assert_eq(server_lag_bucket(7),  7);
+	assert_eq(server_lag_bucket(8),  8);
+	assert_eq(server_lag_bucket(9),  8);
+	assert_eq(server_lag_bucket(10), 9);
+	assert_eq(server_lag_bucket(15), 11);
+	assert_eq(server_lag_bucket(16), 12);
+	assert_eq(server_lag_bucket(-1U), SERVER_LAG_BUCKETS - 1);
+
+	assert_eq(server_lag_bucket_max(0),  0);
+	assert_eq(server_lag_bucket_max(7),  7);
+	assert_eq(server_lag_bucket_max(8),  9);
+	assert_eq(server_lag_bucket_max(11), 15);
+	assert_eq(server_lag_bucket_max(12), 19);
+	assert_eq(server_lag_bucket_max(SERVER_LAG_BUCKETS - 1), -1U);
+
+	for (unsigned i = 0; i < SERVER_LAG_BUCKETS - 1; i++) {
+		assert_eq(server_lag_bucket(server_lag_bucket_max(i)), i);
+		assert_eq(server_lag_bucket(server_lag_bucket_max(i) + 1), i + 1);
+	}
+
+	/* percentiles */
+	assert_eq(server_lag_pct(s, 50), 0);
+
+	for (unsigned i = 0; i < 98; i++)
+		server_lag_add(s, 5);
+
+	server_lag_add(s, 100);
+	server_lag_add(s, 1000);
+
+	assert_eq(s->lag.count, 100);
+	assert_eq(s->lag.last, 1000);
+	assert_eq(server_lag_pct(s, 0),   5);
+	assert_eq(server_lag_pct(s, 50),  5);
+	assert_eq(server_lag_pct(s, 98),  5);
+	assert_eq(server_lag_pct(s, 99),  111);
+	assert_eq(server_lag_pct(s, 100), 1023);
+
+	/* probe and pong */
+	assert_eq(server_lag_pong(s, "rirc.1"), -1);
+	assert_strcmp(server_lag_probe(s), "rirc.1");
+	assert_eq(server_lag_pong(s, "rirc.2"), -1);
+	assert_eq(server_lag_pong(s, "rirc.1"), 0);
+	assert_eq(server_lag_pong(s, "rirc.1"), -1);
+	assert_eq(s->lag.count, 101);
+
+	/* unanswered probe replaced, recorded as a lower bound */
+	assert_strcmp(server_lag_probe(s), "rirc.2");
+	assert_eq(s->lag.count, 101);
+	assert_strcmp(server_lag_probe(s), "rirc.3");
+	assert_eq(s->lag.count, 102);
+	assert_eq(server_lag_pong(s, "rirc.2"), -1);
+	assert_eq(server_lag_pong(s, "rirc.3"), 0);
+	assert_eq(s->lag.count, 103);
+
+	server_reset(s);
+
+	assert_eq(s->lag.count, 0);
+	assert_eq(server_lag_pct(s, 50), 0);
+
+	server_free(s);
+}
+
+static void
+test_server_isupport(void)
+{
+	struct server *s = server("host", "port", NULL, "user", "real");
+
+	char opts1[] = "CHANTYPES=# EXCEPTS MODES=5 NETWORK=test :are supported";
+	char opts2[] = "-NETWORK MODES=4 -UNKNOWN";
+	char opts3[] = "TARGMAX=JOIN:,PRIVMSG:4,NOTICE:3,KICK:1 MAXTARGETS=2";
+	char opts4[] = "MAXTARGETS=2";
+
+	assert_ptr_null(server_isupport(s, "CHANTYPES"));
+
+	server_set_005(s, opts1);
+
+	assert_strcmp(server_isupport(s, "CHANTYPES"), "#");
+	assert_strcmp(server_isupport(s, "EXCEPTS"), "");
+	assert_strcmp(server_isupport(s, "MODES"), "5");
+	assert_strcmp(server_isupport(s, "NETWORK"), "test");
+	assert_ptr_null(server_isupport(s, "are"));
+	assert_eq(s->mode_cfg.MODES, 5);
+
+	/* Test replacing and negating tokens */
+	server_set_005(s, opts2);
+
+	assert_strcmp(server_isupport(s, "MODES"), "4");
+	assert_ptr_null(server_isupport(s, "NETWORK"));
+	assert_ptr_null(server_isupport(s, "-NETWORK"));
+	assert_strcmp(server_isupport(s, "CHANTYPES"), "#");
+	assert_ueq(s->isupport.n, 3);
+
+	/* Test defaults without TARGMAX */
+	assert_eq(server_targmax(s, "JOIN"), 0);
+	assert_eq(server_targmax(s, "PART"), 0);
+	assert_eq(server_targmax(s, "PRIVMSG"), 1);
+	assert_eq(server_targmax(s, "WHOIS"), 1);
+
+	server_set_005(s, opts4);
+
+	assert_eq(server_targmax(s, "PRIVMSG"), 2);
+	assert_eq(server_targmax(s, "NOTICE"), 2);
+	assert_eq(server_targmax(s, "WHOIS"), 1);
+
+	/* Test TARGMAX takes precedence over MAXTARGETS */
+	server_set_005(s, opts3);
+
+	assert_eq(server_targmax(s, "JOIN"), 0);
+	assert_eq(server_targmax(s, "PART"), 0);
+	assert_eq(server_targmax(s, "PRIVMSG"), 4);
+	assert_eq(server_targmax(s, "NOTICE"), 3);
+	assert_eq(server_targmax(s, "KICK"), 1);
+	assert_eq(server_targmax(s, "PRIV"), 1);
+	assert_eq(server_targmax(s, "WHOIS"), 1);
+
+	/* Test tokens are cleared on reset */
+	server_reset(s);
+
+	assert_ptr_null(server_isupport(s, "CHANTYPES"));
+	assert_eq(server_targmax(s, "PRIVMSG"), 1);
+
+	server_free(s);
+}
+
 int
 main(void)
 {
@@ -301,6 +433,8 @@ main(void)
 		TESTCASE(test_server_list),
 		TESTCASE(test_server_set_chans),
 		TESTCASE(test_server_set_nicks),
+		TESTCASE(test_server_lag),
+		TESTCASE(test_server_isupport),
 		TESTCASE(test_parse_005)
 	};
 
@@ -9,6 +9,7 @@
 #include "src/components/user.c"
 #include "src/draw.c"
 #include "src/state.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 #include "test/handlers/irc_recv.mock.c"
@@ -12,6 +12,7 @@
 #include "src/handlers/irc_ctcp.c"
 #include "src/handlers/irc_recv.c"
 #include "src/handlers/ircv3.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 #include "test/draw.mock.c"
 
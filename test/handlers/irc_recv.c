@@ -11,6 +11,7 @@
 #include "src/handlers/irc_ctcp.c"
 #include "src/handlers/irc_recv.c"
 #include "src/handlers/ircv3.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 #include "test/draw.mock.c"
@@ -152,6 +153,77 @@ test_irc_generic_unknown(void)
 	assert_strcmp(mock_line[0], "[COMMAND] [arg1 arg2] ~ trailing arg");
 }
 
+static void
+test_irc_numeric_001(void)
+{
+	/* 001 :<Welcome message> */
+
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	assert_strcmp(mock_line[0], "welcome");
+	assert_strcmp(mock_line[1], "You are known as me");
+	assert_eq(s->registered, 1);
+}
+
+static void
+test_irc_numeric_376(void)
+{
+	/* 376 :<End of MOTD>
+	 * 422 :<MOTD File is missing> */
+
+	c2->parted = 1;
+
+	/* Test joining channels at the end of registration, in one line */
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV(":hostname 376 me :End of MOTD", 0, 0, 1);
+	assert_strcmp(mock_send[0], "JOIN #c1,#c3");
+
+	/* Test joining channels up to TARGMAX per line, as advertised
+	 * between 001 and the end of registration */
+	c2->parted = 0;
+
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV(":hostname 005 me TARGMAX=JOIN:2 :are supported by this server", 0, 1, 0);
+	CHECK_RECV(":hostname 422 me :MOTD File is missing", 0, 1, 2);
+	assert_strcmp(mock_send[0], "JOIN #c1,#c2");
+	assert_strcmp(mock_send[1], "JOIN #c3");
+
+	/* Test joining once per registration */
+	CHECK_RECV(":hostname 376 me :End of MOTD", 0, 0, 0);
+	CHECK_RECV(":hostname 422 me :MOTD File is missing", 0, 1, 0);
+	CHECK_RECV("PING server", 0, 0, 1);
+	assert_strcmp(mock_send[0], "PONG server");
+
+	/* Test joined channels are not joined again */
+	CHECK_RECV(":me!user@host JOIN #c1", 0, 1, 1);
+	CHECK_RECV(":me!user@host JOIN #c3", 0, 1, 1);
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV(":hostname 376 me :End of MOTD", 0, 0, 1);
+	assert_strcmp(mock_send[0], "JOIN #c2");
+
+	/* Test rejoining channels after reconnecting */
+	for (struct channel *c = s->channel; (c = c->next) != s->channel; )
+		channel_reset(c);
+
+	server_reset(s);
+
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV(":hostname 376 me :End of MOTD", 0, 0, 1);
+	assert_strcmp(mock_send[0], "JOIN #c1,#c2,#c3");
+
+	/* Test joining without a MOTD numeric, by the first PING or PONG */
+	server_reset(s);
+
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV("PING server", 0, 0, 2);
+	assert_strcmp(mock_send[0], "PONG server");
+	assert_strcmp(mock_send[1], "JOIN #c1,#c2,#c3");
+
+	CHECK_RECV(":hostname 001 me :welcome", 0, 2, 0);
+	CHECK_RECV("PONG server", 0, 0, 1);
+	assert_strcmp(mock_send[0], "JOIN #c1,#c2,#c3");
+	CHECK_RECV("PONG server", 0, 0, 0);
+}
+
 static void
 test_irc_numeric_353(void)
 {
@@ -723,6 +795,19 @@ test_recv_pong(void)
 	CHECK_RECV("PONG", 0, 0, 0);
 	CHECK_RECV("PONG s1", 0, 0, 0);
 	CHECK_RECV("PONG s1 s2", 0, 0, 0);
+
+	/* latency probe tokens */
+	assert_strcmp(server_lag_probe(s), "rirc.1");
+	CHECK_RECV("PONG s1 :rirc.2", 0, 0, 0);
+	assert_eq(s->lag.count, 0);
+	CHECK_RECV("PONG s1 :rirc.1", 0, 0, 0);
+	assert_eq(s->lag.count, 1);
+	CHECK_RECV("PONG s1 :rirc.1", 0, 0, 0);
+	assert_eq(s->lag.count, 1);
+
+	assert_strcmp(server_lag_probe(s), "rirc.2");
+	CHECK_RECV("PONG rirc.2", 0, 0, 0);
+	assert_eq(s->lag.count, 2);
 }
 
 static void
@@ -930,6 +1015,131 @@ test_recv_ircv3_away(void)
 	assert_strcmp(mock_chan[0], "#c3");
 }
 
+static void
+test_recv_ircv3_batch(void)
+{
+	/* BATCH +<reference> <type> [<params>]
+	 * BATCH -<reference> */
+
+	#define CHECK_BATCHED(L, RET) \
+		assert_eq(irc_recv_batched(s, (L), strlen(L)), (RET))
+
+	channel_reset(c1);
+	channel_reset(c2);
+	channel_reset(c3);
+	server_reset(s);
+
+	assert_eq(user_list_add(&(c1->users), CASEMAPPING_RFC1459, "nick1", MODE_EMPTY), USER_ERR_NONE);
+	assert_eq(user_list_add(&(c1->users), CASEMAPPING_RFC1459, "nick2", MODE_EMPTY), USER_ERR_NONE);
+	assert_eq(user_list_add(&(c1->users), CASEMAPPING_RFC1459, "nick3", MODE_EMPTY), USER_ERR_NONE);
+	assert_eq(user_list_add(&(c3->users), CASEMAPPING_RFC1459, "nick1", MODE_EMPTY), USER_ERR_NONE);
+
+	threshold_join = 0;
+	threshold_quit = 0;
+
+	CHECK_RECV("BATCH", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: reference is null");
+
+	CHECK_RECV("BATCH ref", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: invalid reference 'ref'");
+
+	CHECK_RECV("BATCH +", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: invalid reference '+'");
+
+	CHECK_RECV("BATCH +ref", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: type is null");
+
+	CHECK_RECV("BATCH -ref", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: reference 'ref' not found");
+
+	/* test no open batches */
+	CHECK_BATCHED("@batch=ref :nick1!user@host QUIT", 0);
+
+	/* test netsplit, users removed per channel when the batch ends */
+	CHECK_RECV("BATCH +ref netsplit irc.a.net irc.b.net", 0, 0, 0);
+	assert_ptr_not_null(s->batches);
+	assert_strcmp(s->batches->type, "netsplit");
+	assert_strcmp(s->batches->params, "irc.a.net irc.b.net");
+
+	CHECK_RECV("BATCH +ref netsplit", 1, 1, 0);
+	assert_strcmp(mock_line[0], "BATCH: duplicate reference 'ref'");
+
+	CHECK_BATCHED("@batch=ref :nick1!user@host QUIT :irc.a.net irc.b.net", 1);
+	CHECK_BATCHED("@batch=ref :nick2!user@host QUIT :irc.a.net irc.b.net", 1);
+	CHECK_BATCHED("@batch=ref :nick4!user@host QUIT :irc.a.net irc.b.net", 1);
+	CHECK_BATCHED("@batch=xxx :nick3!user@host QUIT", 0);
+	CHECK_BATCHED("@time=x :nick3!user@host QUIT", 0);
+	CHECK_BATCHED(":nick3!user@host QUIT", 0);
+
+	assert_ueq(s->batches->count, 3);
+	assert_ptr_not_null(user_list_get(&(c1->users), s->casemapping, "nick1", 0));
+
+	CHECK_RECV("BATCH -ref", 0, 2, 0);
+	assert_strcmp(mock_chan[0], "#c1");
+	assert_strcmp(mock_line[0], "Netsplit irc.a.net irc.b.net, 2 users have quit");
+	assert_strcmp(mock_chan[1], "#c3");
+	assert_strcmp(mock_line[1], "Netsplit irc.a.net irc.b.net, 1 user has quit");
+	assert_ptr_null(user_list_get(&(c1->users), s->casemapping, "nick1", 0));
+	assert_ptr_null(user_list_get(&(c1->users), s->casemapping, "nick2", 0));
+	assert_ptr_null(user_list_get(&(c3->users), s->casemapping, "nick1", 0));
+	assert_ptr_not_null(user_list_get(&(c1->users), s->casemapping, "nick3", 0));
+	assert_ptr_null(s->batches);
+
+	/* test netjoin, other lines handled in order */
+	CHECK_RECV("BATCH +ref netjoin irc.a.net irc.b.net", 0, 0, 0);
+	CHECK_BATCHED("@batch=ref :nick1!user@host JOIN #c1", 1);
+	CHECK_BATCHED("@batch=ref :nick2!user@host JOIN #c1", 1);
+	CHECK_BATCHED("@batch=ref :nick3!user@host JOIN #c1", 1);
+	CHECK_BATCHED("@batch=ref :nick1!user@host JOIN #c3", 1);
+	CHECK_BATCHED("@batch=ref :nick1!user@host JOIN #notfound", 1);
+	CHECK_BATCHED("@batch=ref :nick1!user@host TOPIC #c1 topic", 1);
+	CHECK_BATCHED("@batch=ref :nick2!user@host JOIN #c3", 1);
+
+	CHECK_RECV("BATCH -ref", 0, 5, 0);
+	assert_strcmp(mock_chan[0], "#c1");
+	assert_strcmp(mock_line[0], "Netjoin irc.a.net irc.b.net, 2 users have joined");
+	assert_strcmp(mock_chan[1], "#c3");
+	assert_strcmp(mock_line[1], "Netjoin irc.a.net irc.b.net, 1 user has joined");
+	assert_strcmp(mock_line[2], "nick1 has set the topic:");
+	assert_strcmp(mock_line[3], "\"topic\"");
+	assert_strcmp(mock_chan[4], "#c3");
+	assert_strcmp(mock_line[4], "Netjoin irc.a.net irc.b.net, 1 user has joined");
+	assert_ptr_not_null(user_list_get(&(c1->users), s->casemapping, "nick1", 0));
+	assert_ptr_not_null(user_list_get(&(c1->users), s->casemapping, "nick2", 0));
+	assert_ptr_not_null(user_list_get(&(c3->users), s->casemapping, "nick1", 0));
+	assert_ptr_not_null(user_list_get(&(c3->users), s->casemapping, "nick2", 0));
+
+	/* test nested batches, opened when their parent ends */
+	CHECK_RECV("BATCH +ref1 chathistory #c1", 0, 0, 0);
+	CHECK_BATCHED("@batch=ref1 :irc.a.net BATCH +ref2 netsplit", 1);
+	CHECK_BATCHED("@batch=ref2 :nick1!user@host QUIT", 1);
+	CHECK_BATCHED("@batch=ref2 :nick2!user@host QUIT", 1);
+	CHECK_BATCHED("@batch=ref1 :irc.a.net BATCH -ref2", 1);
+	CHECK_BATCHED("@batch=ref2 :nick3!user@host QUIT", 0);
+	CHECK_BATCHED("@batch=ref1 :irc.a.net BATCH +ref3 netsplit", 1);
+	CHECK_BATCHED("@batch=ref3 :nick3!user@host QUIT", 1);
+
+	assert_ueq(s->batches->count, 0);
+	assert_ueq(s->batches->next->count, 6);
+
+	/* ref3 is opened when ref1 ends, and remains open */
+	CHECK_RECV("BATCH -ref1", 0, 2, 0);
+	assert_strcmp(mock_chan[0], "#c1");
+	assert_strcmp(mock_line[0], "Netsplit, 2 users have quit");
+	assert_strcmp(mock_chan[1], "#c3");
+	assert_strcmp(mock_line[1], "Netsplit, 2 users have quit");
+	assert_ptr_not_null(s->batches);
+	assert_strcmp(s->batches->ref, "ref3");
+	assert_ueq(s->batches->count, 1);
+
+	/* test batches dropped on reset */
+	server_reset(s);
+
+	assert_ptr_null(s->batches);
+
+	#undef CHECK_BATCHED
+}
+
 static void
 test_recv_ircv3_chghost(void)
 {
@@ -1018,7 +1228,9 @@ main(void)
 		TESTCASE(test_irc_generic_ignore),
 		TESTCASE(test_irc_generic_info),
 		TESTCASE(test_irc_generic_unknown),
+		TESTCASE(test_irc_numeric_001),
 		TESTCASE(test_irc_numeric_353),
+		TESTCASE(test_irc_numeric_376),
 		TESTCASE(test_irc_numeric_401),
 		TESTCASE(test_irc_numeric_403),
 		TESTCASE(test_recv),
@@ -1041,6 +1253,7 @@ main(void)
 		TESTCASE(test_recv_ircv3_cap),
 		TESTCASE(test_recv_ircv3_account),
 		TESTCASE(test_recv_ircv3_away),
+		TESTCASE(test_recv_ircv3_batch),
 		TESTCASE(test_recv_ircv3_chghost)
 	};
 
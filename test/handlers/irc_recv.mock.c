@@ -1,7 +1,35 @@
+#define MOCK_RECV_LEN 512
+#define MOCK_RECV_N   10
+
+static char mock_recv[MOCK_RECV_N][MOCK_RECV_LEN];
+static unsigned mock_recv_n;
+
+void
+mock_reset_recv(void)
+{
+	mock_recv_n = 0;
+	memset(mock_recv, 0, MOCK_RECV_LEN * MOCK_RECV_N);
+}
+
 int
 irc_recv(struct server *s, struct irc_message *m)
 {
 	UNUSED(s);
-	UNUSED(m);
+
+	if (mock_recv_n < MOCK_RECV_N)
+		snprintf(mock_recv[mock_recv_n], sizeof(mock_recv[0]), "%s", m->command);
+
+	mock_recv_n++;
+
+	return 0;
+}
+
+int
+irc_recv_batched(struct server *s, const char *line, size_t len)
+{
+	UNUSED(s);
+	UNUSED(line);
+	UNUSED(len);
+
 	return 0;
 }
@@ -8,6 +8,7 @@
 #include "src/components/server.c"
 #include "src/components/user.c"
 #include "src/handlers/irc_send.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 #include "test/io.mock.c"
@@ -121,6 +122,70 @@ test_send_away(void)
 	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "AWAY :testing away message");
 }
 
+static void
+test_send_ban(void)
+{
+	char m1[] = "ban";
+	char m2[] = "ban *!*@host";
+	char m3[] = "ban *!*@host";
+	char m4[] = "ban a!*@* b!*@* c!*@* d!*@*";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /ban <mask> [mask ...]", "");
+	CHECK_SEND_COMMAND(c_serv, m2, 1, 1, 0, "This is not a channel", "");
+	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "MODE chan +b *!*@host");
+	CHECK_SEND_COMMAND(c_chan, m4, 0, 0, 2, "", "MODE chan +bbb a!*@* b!*@* c!*@*");
+	assert_strcmp(mock_send[1], "MODE chan +b d!*@*");
+}
+
+static void
+test_send_deop(void)
+{
+	char m1[] = "deop";
+	char m2[] = "deop n1 n2";
+	char m3[] = "deop n1 n2";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /deop <nick> [nick ...]", "");
+	CHECK_SEND_COMMAND(c_priv, m2, 1, 1, 0, "This is not a channel", "");
+	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "MODE chan -oo n1 n2");
+}
+
+static void
+test_send_devoice(void)
+{
+	char m1[] = "devoice";
+	char m2[] = "devoice n1 n2";
+	char m3[] = "devoice n1 n2";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /devoice <nick> [nick ...]", "");
+	CHECK_SEND_COMMAND(c_priv, m2, 1, 1, 0, "This is not a channel", "");
+	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "MODE chan -vv n1 n2");
+}
+
+static void
+test_send_join(void)
+{
+	char m1[] = "join";
+	char m2[] = "join #c1";
+	char m3[] = "join #c1,#c2,#c3 k1,k2";
+	char m4[] = "join #c1,#c2,#c3 k1,k2";
+	char m5[] = "join #c1,#c2,#c3,#c4,#c5";
+	char targmax[] = "TARGMAX=JOIN:2";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /join <channel>[,channel ...] [key[,key ...]]", "");
+	CHECK_SEND_COMMAND(c_serv, m2, 0, 0, 1, "", "JOIN #c1");
+	CHECK_SEND_COMMAND(c_serv, m3, 0, 0, 1, "", "JOIN #c1,#c2,#c3 k1,k2");
+
+	server_set_005(s, targmax);
+
+	/* test keys remain positional */
+	CHECK_SEND_COMMAND(c_serv, m4, 0, 0, 2, "", "JOIN #c1,#c2 k1,k2");
+	assert_strcmp(mock_send[1], "JOIN #c3");
+
+	CHECK_SEND_COMMAND(c_serv, m5, 0, 0, 3, "", "JOIN #c1,#c2");
+	assert_strcmp(mock_send[1], "JOIN #c3,#c4");
+	assert_strcmp(mock_send[2], "JOIN #c5");
+}
+
 static void
 test_send_notice(void)
 {
@@ -135,6 +200,55 @@ test_send_notice(void)
 	CHECK_SEND_COMMAND(c_chan, m3, 1, 1, 0, "Usage: /notice <target> <message>", "");
 	CHECK_SEND_COMMAND(c_chan, m4, 0, 0, 1, "", "NOTICE test3 : ");
 	CHECK_SEND_COMMAND(c_chan, m5, 0, 0, 1, "", "NOTICE test4 :test notice message");
+
+	/* test multiple targets, up to MAXTARGETS per line */
+	char m6[] = "notice t1,t2,t3 test";
+	char m7[] = "notice t1,t2,t3 test";
+	char maxtargets[] = "MAXTARGETS=2";
+
+	CHECK_SEND_COMMAND(c_chan, m6, 0, 0, 3, "", "NOTICE t1 :test");
+	assert_strcmp(mock_send[1], "NOTICE t2 :test");
+	assert_strcmp(mock_send[2], "NOTICE t3 :test");
+
+	server_set_005(s, maxtargets);
+
+	CHECK_SEND_COMMAND(c_chan, m7, 0, 0, 2, "", "NOTICE t1,t2 :test");
+	assert_strcmp(mock_send[1], "NOTICE t3 :test");
+}
+
+static void
+test_send_op(void)
+{
+	/* test up to MODES per line */
+
+	char m1[] = "op";
+	char m2[] = "op n1";
+	char m3[] = "op n1";
+	char m4[] = "op n1 n2 n3";
+	char m5[] = "op n1 n2 n3 n4 n5 n6 n7";
+	char m6[1024] = "op";
+	char m7[] = "op n1 n2 n3 n4 n5 n6 n7";
+	char modes[] = "MODES=5";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /op <nick> [nick ...]", "");
+	CHECK_SEND_COMMAND(c_serv, m2, 1, 1, 0, "This is not a channel", "");
+	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "MODE chan +o n1");
+	CHECK_SEND_COMMAND(c_chan, m4, 0, 0, 1, "", "MODE chan +ooo n1 n2 n3");
+	CHECK_SEND_COMMAND(c_chan, m5, 0, 0, 3, "", "MODE chan +ooo n1 n2 n3");
+	assert_strcmp(mock_send[1], "MODE chan +ooo n4 n5 n6");
+	assert_strcmp(mock_send[2], "MODE chan +o n7");
+
+	server_set_005(s, modes);
+
+	/* test 50 changes in 10 lines */
+	for (int i = 0; i < 50; i++)
+		snprintf(m6 + strlen(m6), sizeof(m6) - strlen(m6), " nick%d", i);
+
+	CHECK_SEND_COMMAND(c_chan, m6, 0, 0, 10, "", "MODE chan +ooooo nick0 nick1 nick2 nick3 nick4");
+	assert_strcmp(mock_send[9], "MODE chan +ooooo nick45 nick46 nick47 nick48 nick49");
+
+	CHECK_SEND_COMMAND(c_chan, m7, 0, 0, 2, "", "MODE chan +ooooo n1 n2 n3 n4 n5");
+	assert_strcmp(mock_send[1], "MODE chan +oo n6 n7");
 }
 
 static void
@@ -149,6 +263,26 @@ test_send_part(void)
 	CHECK_SEND_COMMAND(c_priv, m2, 1, 1, 0, "This is not a channel", "");
 	CHECK_SEND_COMMAND(c_chan, m3, 0, 0, 1, "", "PART chan :" DEFAULT_PART_MESG);
 	CHECK_SEND_COMMAND(c_chan, m4, 0, 0, 1, "", "PART chan :test part message");
+
+	/* test parting multiple channels, from any channel */
+	char m5[] = "part #c1,#c2,&c3";
+	char m6[] = "part #c1,#c2,&c3 test part message";
+	char m7[] = "part #c1,#c2,&c3";
+	char m8[] = "part &c1 test";
+	char targmax[] = "TARGMAX=PART:2";
+	char chantypes[] = "CHANTYPES=#";
+
+	CHECK_SEND_COMMAND(c_serv, m5, 0, 0, 1, "", "PART #c1,#c2,&c3 :" DEFAULT_PART_MESG);
+	CHECK_SEND_COMMAND(c_priv, m6, 0, 0, 1, "", "PART #c1,#c2,&c3 :test part message");
+
+	server_set_005(s, targmax);
+
+	CHECK_SEND_COMMAND(c_chan, m7, 0, 0, 2, "", "PART #c1,#c2 :" DEFAULT_PART_MESG);
+	assert_strcmp(mock_send[1], "PART &c3 :" DEFAULT_PART_MESG);
+
+	server_set_005(s, chantypes);
+
+	CHECK_SEND_COMMAND(c_chan, m8, 0, 0, 1, "", "PART chan :&c1 test");
 }
 
 static void
@@ -189,10 +323,13 @@ test_send_privmsg(void)
 	assert_eq(c1->type, CHANNEL_T_CHANNEL);
 	assert_eq(s->clist.count, 4);
 
-	/* test sending to multiple new targets */
+	/* test sending to multiple new targets, one per line without TARGMAX */
 	char m7[] = "privmsg #new2,priv1,#new3,priv2 test 3";
 
-	CHECK_SEND_COMMAND(c_chan, m7, 0, 4, 1, "test 3", "PRIVMSG #new2,priv1,#new3,priv2 :test 3");
+	CHECK_SEND_COMMAND(c_chan, m7, 0, 4, 4, "test 3", "PRIVMSG #new2 :test 3");
+	assert_strcmp(mock_send[1], "PRIVMSG priv1 :test 3");
+	assert_strcmp(mock_send[2], "PRIVMSG #new3 :test 3");
+	assert_strcmp(mock_send[3], "PRIVMSG priv2 :test 3");
 
 	if (!(c1 = channel_list_get(&(s->clist), "#new2", s->casemapping)))
 		test_abort("channel '#new2' not found");
@@ -212,10 +349,14 @@ test_send_privmsg(void)
 	assert_eq(c4->type, CHANNEL_T_PRIVMSG);
 	assert_eq(s->clist.count, 8);
 
-	/* test with some duplicates channels */
+	/* test with some duplicates channels, up to TARGMAX per line */
 	char m8[] = "privmsg priv3,priv1,priv2 test 4";
+	char targmax[] = "TARGMAX=NOTICE:,PRIVMSG:2";
 
-	CHECK_SEND_COMMAND(c_chan, m8, 0, 3, 1, "test 4", "PRIVMSG priv3,priv1,priv2 :test 4");
+	server_set_005(s, targmax);
+
+	CHECK_SEND_COMMAND(c_chan, m8, 0, 3, 2, "test 4", "PRIVMSG priv3,priv1 :test 4");
+	assert_strcmp(mock_send[1], "PRIVMSG priv2 :test 4");
 
 	if (!(c1 = channel_list_get(&(s->clist), "priv3", s->casemapping)))
 		test_abort("channel 'priv3' not found");
@@ -224,6 +365,27 @@ test_send_privmsg(void)
 	assert_eq(s->clist.count, 9);
 }
 
+static void
+test_send_unban(void)
+{
+	char m1[] = "unban";
+	char m2[] = "unban *!*@host";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /unban <mask> [mask ...]", "");
+	CHECK_SEND_COMMAND(c_chan, m2, 0, 0, 1, "", "MODE chan -b *!*@host");
+}
+
+static void
+test_send_voice(void)
+{
+	char m1[] = "voice";
+	char m2[] = "voice n1 n2 n3 n4";
+
+	CHECK_SEND_COMMAND(c_chan, m1, 1, 1, 0, "Usage: /voice <nick> [nick ...]", "");
+	CHECK_SEND_COMMAND(c_chan, m2, 0, 0, 2, "", "MODE chan +vvv n1 n2 n3");
+	assert_strcmp(mock_send[1], "MODE chan +v n4");
+}
+
 static void
 test_send_quit(void)
 {
@@ -46,6 +46,13 @@ connection(const void *o, const char *h, const char *p, uint32_t f)
 	return NULL;
 }
 
+void
+connection_tcp_opts(struct connection *c, const struct io_tcp_opts *o)
+{
+	UNUSED(c);
+	UNUSED(o);
+}
+
 int
 io_cx(struct connection *c)
 {
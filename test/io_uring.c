@@ -0,0 +1,154 @@
+/* syscall(2), MAP_ANONYMOUS, MAP_POPULATE */
+#define _DEFAULT_SOURCE 1
+
+#include "test/test.h"
+
+#include "src/io_uring.c"
+#include "src/utils/utils.c"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+static struct uring *u;
+
+static void
+test_uring_read_multishot(void)
+{
+	int fds[2];
+	struct uring_cqe cqe;
+
+	if (!u)
+		return;
+
+	assert_eq(pipe(fds), 0);
+	assert_eq(uring_read_multishot(u, fds[0], 1), 0);
+	assert_eq(uring_submit(u, 0), 0);
+
+	/* reads remain armed, each into a provided buffer */
+	for (int i = 0; i < 8; i++) {
+		assert_eq(write(fds[1], "abc", 3), 3);
+		assert_eq(uring_submit(u, 1), 0);
+		assert_eq(uring_cqe_next(u, &cqe), 1);
+		assert_eq(cqe.data, 1);
+		assert_eq(cqe.res, 3);
+		assert_true(cqe.more);
+		assert_ptr_not_null(cqe.buf);
+		assert_strncmp(cqe.buf, "abc", 3);
+		uring_buf_put(u, cqe.bid);
+	}
+
+	assert_eq(uring_cqe_next(u, &cqe), 0);
+
+	/* end of file terminates the request */
+	assert_eq(close(fds[1]), 0);
+	assert_eq(uring_submit(u, 1), 0);
+	assert_eq(uring_cqe_next(u, &cqe), 1);
+	assert_eq(cqe.res, 0);
+	assert_false(cqe.more);
+
+	assert_eq(close(fds[0]), 0);
+}
+
+static void
+test_uring_send(void)
+{
+	char buf[16] = {0};
+	int fds[2];
+	struct uring_cqe cqe;
+
+	if (!u)
+		return;
+
+	assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+	assert_eq(uring_send(u, fds[0], "abc", 3, 2), 0);
+	assert_eq(uring_send(u, fds[0], "def", 3, 3), 0);
+	assert_eq(uring_submit(u, 2), 0);
+
+	assert_eq(uring_cqe_next(u, &cqe), 1);
+	assert_eq(cqe.data, 2);
+	assert_eq(cqe.res, 3);
+	assert_ptr_null(cqe.buf);
+	assert_eq(uring_cqe_next(u, &cqe), 1);
+	assert_eq(cqe.data, 3);
+	assert_eq(cqe.res, 3);
+	assert_eq(uring_cqe_next(u, &cqe), 0);
+
+	assert_eq(read(fds[1], buf, sizeof(buf)), 6);
+	assert_strcmp(buf, "abcdef");
+
+	assert_eq(close(fds[0]), 0);
+	assert_eq(close(fds[1]), 0);
+}
+
+static void
+test_uring_submit_timeout(void)
+{
+	int fds[2];
+	struct uring_cqe cqe;
+
+	if (!u)
+		return;
+
+	assert_eq(pipe(fds), 0);
+	assert_eq(uring_read_multishot(u, fds[0], 1), 0);
+
+	errno = 0;
+	assert_eq(uring_submit_timeout(u, 1, 10), -1);
+	assert_eq(errno, ETIME);
+	assert_eq(uring_cqe_next(u, &cqe), 0);
+
+	assert_eq(write(fds[1], "abc", 3), 3);
+	assert_eq(uring_submit_timeout(u, 1, 1000), 0);
+	assert_eq(uring_cqe_next(u, &cqe), 1);
+	assert_eq(cqe.res, 3);
+	uring_buf_put(u, cqe.bid);
+
+	assert_eq(close(fds[1]), 0);
+	assert_eq(uring_submit_timeout(u, 1, -1), 0);
+	assert_eq(uring_cqe_next(u, &cqe), 1);
+	assert_eq(cqe.res, 0);
+
+	assert_eq(close(fds[0]), 0);
+}
+
+static void
+test_uring_invalid(void)
+{
+	/* buffer count must be a power of 2 */
+	assert_ptr_null(uring(8, 3, 16));
+	assert_ptr_null(uring(8, 0, 16));
+}
+
+static int
+test_init(void)
+{
+	/* Unsupported systems test only the fallback */
+	u = uring(8, 4, 16);
+
+	return 0;
+}
+
+static int
+test_term(void)
+{
+	if (u)
+		uring_free(u);
+
+	u = NULL;
+
+	return 0;
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_uring_read_multishot),
+		TESTCASE(test_uring_send),
+		TESTCASE(test_uring_submit_timeout),
+		TESTCASE(test_uring_invalid),
+	};
+
+	return run_tests(test_init, test_term, tests);
+}
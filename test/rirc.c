@@ -9,6 +9,7 @@
 #include "src/components/user.c"
 #include "src/rirc.c"
 #include "src/state.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 #include "test/draw.mock.c"
@@ -9,6 +9,7 @@
 #include "src/components/user.c"
 #include "src/handlers/irc_send.c"
 #include "src/state.c"
+#include "src/utils/highlight.c"
 #include "src/utils/utils.c"
 
 #include "test/draw.mock.c"
@@ -308,6 +309,51 @@ test_command_quit(void)
 	state_term();
 }
 
+static void
+test_io_cb_read_soc(void)
+{
+	char buf[] =
+		"CMD1 arg\r\n"
+		"\r\n"
+		"\x02" "C\x03" "MD2\x7f arg\r\n"
+		"CMD3\n"
+		"\x01" "CMD4\x01\r\n"
+		"CMD5\xc3\xa9\r\n"
+		"CMD6\xe9\r\n";
+
+	char buf_latin1[] =
+		"CMD7\xc3\xa9\r\n"
+		"CMD8\xe9\x80\r\n";
+
+	struct server *s = server("h1", "p1", NULL, "u1", "r1");
+
+	state_init();
+	mock_reset_recv();
+
+	io_cb_read_soc(buf, sizeof(buf) - 1, s);
+
+	assert_eq(mock_recv_n, 6);
+	assert_strcmp(mock_recv[0], "CMD1");
+	assert_strcmp(mock_recv[1], "CMD2");
+	assert_strcmp(mock_recv[2], "CMD3");
+	assert_strcmp(mock_recv[3], "\x01" "CMD4\x01");
+	assert_strcmp(mock_recv[4], "CMD5\xc3\xa9");
+	assert_strcmp(mock_recv[5], "CMD6\xef\xbf\xbd");
+
+	/* Test fallback charset */
+	s->charset = CHARSET_LATIN1;
+	mock_reset_recv();
+
+	io_cb_read_soc(buf_latin1, sizeof(buf_latin1) - 1, s);
+
+	assert_eq(mock_recv_n, 2);
+	assert_strcmp(mock_recv[0], "CMD7\xc3\xa9");
+	assert_strcmp(mock_recv[1], "CMD8\xc3\xa9\xef\xbf\xbd");
+
+	server_free(s);
+	state_term();
+}
+
 static void
 test_state(void)
 {
@@ -372,6 +418,7 @@ main(void)
 		TESTCASE(test_command_connect),
 		TESTCASE(test_command_disconnect),
 		TESTCASE(test_command_quit),
+		TESTCASE(test_io_cb_read_soc),
 		TESTCASE(test_state),
 	};
 
@@ -0,0 +1,130 @@
+#include "test/test.h"
+#include "src/utils/capture.c"
+
+static char line[CAPTURE_LINE_MAX + 1];
+
+static void
+test_capture_header(void)
+{
+	FILE *f;
+
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(capture_header_write(f), 0);
+	rewind(f);
+	assert_eq(capture_header_read(f), 0);
+
+	/* invalid version */
+	rewind(f);
+	assert_eq(fwrite("RIRCCAP\x02", 1, 8, f), 8);
+	rewind(f);
+	assert_eq(capture_header_read(f), -1);
+
+	/* invalid magic */
+	rewind(f);
+	assert_eq(fwrite("RIRCCAX\x01", 1, 8, f), 8);
+	rewind(f);
+	assert_eq(capture_header_read(f), -1);
+
+	fclose(f);
+
+	/* empty */
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(capture_header_read(f), -1);
+
+	fclose(f);
+}
+
+static void
+test_capture_rec(void)
+{
+	FILE *f;
+	struct capture_rec rec;
+
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(capture_header_write(f), 0);
+
+	rec.ns = 0x0102030405060708;
+	rec.dir = CAPTURE_RECV;
+	rec.line = ":nick!user@host PRIVMSG #chan :test";
+	rec.len = strlen(rec.line);
+	assert_eq(capture_write(f, &rec), 0);
+
+	rec.ns = 0x1020304050607080;
+	rec.dir = CAPTURE_SEND;
+	rec.line = "";
+	rec.len = 0;
+	assert_eq(capture_write(f, &rec), 0);
+
+	rewind(f);
+	assert_eq(capture_header_read(f), 0);
+
+	rec.line = line;
+
+	assert_eq(capture_read(f, &rec), 1);
+	assert_true(rec.ns == 0x0102030405060708);
+	assert_eq(rec.dir, CAPTURE_RECV);
+	assert_ueq(rec.len, 35);
+	assert_strcmp(rec.line, ":nick!user@host PRIVMSG #chan :test");
+
+	assert_eq(capture_read(f, &rec), 1);
+	assert_true(rec.ns == 0x1020304050607080);
+	assert_eq(rec.dir, CAPTURE_SEND);
+	assert_ueq(rec.len, 0);
+	assert_strcmp(rec.line, "");
+
+	assert_eq(capture_read(f, &rec), 0);
+
+	fclose(f);
+}
+
+static void
+test_capture_rec_invalid(void)
+{
+	FILE *f;
+	struct capture_rec rec = { .line = line };
+
+	/* truncated header */
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(fwrite("\x00\x00\x00", 1, 3, f), 3);
+	rewind(f);
+	assert_eq(capture_read(f, &rec), -1);
+	fclose(f);
+
+	/* truncated line */
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(fwrite("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x04\x00" "abc", 1, 14, f), 14);
+	rewind(f);
+	assert_eq(capture_read(f, &rec), -1);
+	fclose(f);
+
+	/* invalid direction */
+	if (!(f = tmpfile()))
+		test_abort("tmpfile");
+
+	assert_eq(fwrite("\x00\x00\x00\x00\x00\x00\x00\x00\x02\x03\x00" "abc", 1, 14, f), 14);
+	rewind(f);
+	assert_eq(capture_read(f, &rec), -1);
+	fclose(f);
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_capture_header),
+		TESTCASE(test_capture_rec),
+		TESTCASE(test_capture_rec_invalid),
+	};
+
+	return run_tests(NULL, NULL, tests);
+}
@@ -0,0 +1,166 @@
+#include "test/test.h"
+#include "src/utils/highlight.c"
+#include "src/utils/utils.c"
+
+static struct highlight h;
+
+#define CHECK_HIGHLIGHT(M, R) \
+	assert_eq(highlight_match(&h, (M)), (R));
+
+static void
+test_highlight_nick(void)
+{
+	/* Test detecting user's nick in message */
+
+	const char *words[1];
+
+	words[0] = "nick";
+
+	highlight_set(&h, CASEMAPPING_RFC1459, words, 1);
+
+	CHECK_HIGHLIGHT("nick", 1);
+	CHECK_HIGHLIGHT("nick ", 1);
+	CHECK_HIGHLIGHT("nick:", 1);
+	CHECK_HIGHLIGHT("nick: ", 1);
+	CHECK_HIGHLIGHT(" nick", 1);
+	CHECK_HIGHLIGHT(" nick ", 1);
+	CHECK_HIGHLIGHT(" nick:", 1);
+	CHECK_HIGHLIGHT(" nick: ", 1);
+	CHECK_HIGHLIGHT("xxx 'nick'! ", 1);
+	CHECK_HIGHLIGHT("xxx @nick?! xxx", 1);
+	CHECK_HIGHLIGHT("xxx @NICK?! xxx", 1);
+	CHECK_HIGHLIGHT("xnick nick", 1);
+	CHECK_HIGHLIGHT("nnick nick", 1);
+
+	CHECK_HIGHLIGHT("", 0);
+	CHECK_HIGHLIGHT(" ", 0);
+	CHECK_HIGHLIGHT("xxx", 0);
+	CHECK_HIGHLIGHT("nic", 0);
+	CHECK_HIGHLIGHT("nicks", 0);
+	CHECK_HIGHLIGHT("nick-", 0);
+	CHECK_HIGHLIGHT("xnick", 0);
+	CHECK_HIGHLIGHT("xnick:", 0);
+	CHECK_HIGHLIGHT("xnick: ", 0);
+	CHECK_HIGHLIGHT(" xnick", 0);
+	CHECK_HIGHLIGHT(" xnick:", 0);
+
+	/* Test server assigns a non standard nick */
+	words[0] = "000nick";
+
+	highlight_set(&h, CASEMAPPING_RFC1459, words, 1);
+
+	CHECK_HIGHLIGHT("000nick", 1);
+	CHECK_HIGHLIGHT("000nick ", 1);
+	CHECK_HIGHLIGHT("000nick:", 1);
+	CHECK_HIGHLIGHT("000nick: ", 1);
+	CHECK_HIGHLIGHT(" 000nick", 1);
+	CHECK_HIGHLIGHT(" 000nick ", 1);
+	CHECK_HIGHLIGHT(" 000nick:", 1);
+	CHECK_HIGHLIGHT(" 000nick: ", 1);
+	CHECK_HIGHLIGHT("xxx '000nick'! ", 1);
+	CHECK_HIGHLIGHT("xxx @000nick?! xxx", 1);
+	CHECK_HIGHLIGHT("xxx @000NICK?! xxx", 1);
+
+	CHECK_HIGHLIGHT("nick", 0);
+	CHECK_HIGHLIGHT("x000nick", 0);
+	CHECK_HIGHLIGHT("x000nick:", 0);
+	CHECK_HIGHLIGHT("x000nick: ", 0);
+	CHECK_HIGHLIGHT(" x000nick", 0);
+	CHECK_HIGHLIGHT(" x000nick:", 0);
+	CHECK_HIGHLIGHT("0000nick", 0);
+}
+
+static void
+test_highlight_words(void)
+{
+	/* Test matching any of a set of words */
+
+	const char *words[] = { "nick", "nick_", "", "rirc", "foo bar" };
+
+	highlight_set(&h, CASEMAPPING_RFC1459, words, ARR_LEN(words));
+
+	CHECK_HIGHLIGHT("nick", 1);
+	CHECK_HIGHLIGHT("nick_", 1);
+	CHECK_HIGHLIGHT("nick_: hi", 1);
+	CHECK_HIGHLIGHT("using rirc?", 1);
+	CHECK_HIGHLIGHT("foo bar", 1);
+	CHECK_HIGHLIGHT("xxx FOO BAR xxx", 1);
+
+	CHECK_HIGHLIGHT("", 0);
+	CHECK_HIGHLIGHT("nick__", 0);
+	CHECK_HIGHLIGHT("rircs", 0);
+	CHECK_HIGHLIGHT("foo", 0);
+	CHECK_HIGHLIGHT("bar", 0);
+	CHECK_HIGHLIGHT("foo  bar", 0);
+	CHECK_HIGHLIGHT("foo barx", 0);
+
+	/* Test words found as suffixes of other words */
+	const char *suffixes[] = { "abcd", "bc", "c" };
+
+	highlight_set(&h, CASEMAPPING_RFC1459, suffixes, ARR_LEN(suffixes));
+
+	CHECK_HIGHLIGHT("abc", 0);
+	CHECK_HIGHLIGHT("abcx", 0);
+	CHECK_HIGHLIGHT("abc bc", 1);
+	CHECK_HIGHLIGHT("ab c", 1);
+	CHECK_HIGHLIGHT("a bc", 1);
+	CHECK_HIGHLIGHT("abcabcd", 0);
+	CHECK_HIGHLIGHT("abcab abcd", 1);
+
+	/* Test empty set */
+	highlight_set(&h, CASEMAPPING_RFC1459, words, 0);
+
+	CHECK_HIGHLIGHT("nick", 0);
+
+	highlight_set(&h, CASEMAPPING_RFC1459, words + 2, 1);
+
+	CHECK_HIGHLIGHT("nick", 0);
+	CHECK_HIGHLIGHT("", 0);
+}
+
+static void
+test_highlight_casemapping(void)
+{
+	/* Test words folded by casemapping */
+
+	const char *words[] = { "ni{k}", "a~" };
+
+	highlight_set(&h, CASEMAPPING_ASCII, words, ARR_LEN(words));
+
+	CHECK_HIGHLIGHT("NI{K}", 1);
+	CHECK_HIGHLIGHT("ni[k]", 0);
+	CHECK_HIGHLIGHT("a~", 1);
+	CHECK_HIGHLIGHT("A^", 0);
+
+	highlight_set(&h, CASEMAPPING_RFC1459, words, ARR_LEN(words));
+
+	CHECK_HIGHLIGHT("NI{K}", 1);
+	CHECK_HIGHLIGHT("ni[k]", 1);
+	CHECK_HIGHLIGHT("A^", 1);
+
+	highlight_set(&h, CASEMAPPING_STRICT_RFC1459, words, ARR_LEN(words));
+
+	CHECK_HIGHLIGHT("ni[k]", 1);
+	CHECK_HIGHLIGHT("ni[K]", 1);
+	CHECK_HIGHLIGHT("A^", 0);
+}
+
+static int
+test_term(void)
+{
+	highlight_free(&h);
+
+	return 0;
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_highlight_nick),
+		TESTCASE(test_highlight_words),
+		TESTCASE(test_highlight_casemapping),
+	};
+
+	return run_tests(NULL, test_term, tests);
+}
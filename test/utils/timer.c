@@ -0,0 +1,223 @@
+#include "test/test.h"
+#include "src/utils/timer.c"
+#include "src/utils/utils.h"
+
+struct test_timer
+{
+	struct timer timer;
+	uint64_t fired;
+	unsigned count;
+	uint64_t period;
+};
+
+static struct timer_wheel w;
+
+static void
+test_timer_cb(struct timer *t)
+{
+	struct test_timer *tt = t->arg;
+
+	tt->fired = w.now;
+	tt->count++;
+
+	if (tt->period)
+		timer_add(&w, t, w.now + tt->period);
+}
+
+static void
+test_timer_basic(void)
+{
+	struct test_timer t = {0};
+
+	timer_init(&(t.timer), test_timer_cb, &t);
+
+	assert_true(timer_next(&w) == TIMER_NONE);
+	assert_false(timer_pending(&(t.timer)));
+
+	timer_add(&w, &(t.timer), 1010);
+
+	assert_true(timer_pending(&(t.timer)));
+	assert_true(timer_next(&w) == 1010);
+
+	assert_ueq(timer_run(&w, 1009), 0);
+	assert_ueq(t.count, 0);
+	assert_true(w.now == 1009);
+
+	assert_ueq(timer_run(&w, 1010), 1);
+	assert_ueq(t.count, 1);
+	assert_true(t.fired == 1010);
+	assert_false(timer_pending(&(t.timer)));
+	assert_true(timer_next(&w) == TIMER_NONE);
+
+	/* expired timers fire on the next tick */
+	timer_add(&w, &(t.timer), 0);
+
+	assert_true(timer_next(&w) == 1011);
+	assert_ueq(timer_run(&w, 1010), 0);
+	assert_ueq(timer_run(&w, 2000), 1);
+	assert_true(t.fired == 1011);
+	assert_true(w.now == 2000);
+}
+
+static void
+test_timer_del(void)
+{
+	struct test_timer t1 = {0};
+	struct test_timer t2 = {0};
+
+	timer_init(&(t1.timer), test_timer_cb, &t1);
+	timer_init(&(t2.timer), test_timer_cb, &t2);
+
+	timer_add(&w, &(t1.timer), 1100);
+	timer_add(&w, &(t2.timer), 1100);
+
+	timer_del(&w, &(t1.timer));
+	timer_del(&w, &(t1.timer));
+
+	assert_false(timer_pending(&(t1.timer)));
+	assert_true(timer_pending(&(t2.timer)));
+	assert_true(timer_next(&w) <= 1100);
+
+	timer_del(&w, &(t2.timer));
+
+	assert_true(timer_next(&w) == TIMER_NONE);
+	assert_ueq(timer_run(&w, 100000), 0);
+
+	/* reschedule */
+	timer_add(&w, &(t1.timer), 100050);
+	timer_add(&w, &(t1.timer), 100500);
+
+	assert_ueq(timer_run(&w, 100499), 0);
+	assert_ueq(timer_run(&w, 100500), 1);
+	assert_ueq(t1.count, 1);
+}
+
+static void
+test_timer_levels(void)
+{
+	/* Timers fire at their expiry at every level, and beyond the
+	 * range of the wheel, regardless of the steps taken */
+
+	uint64_t delays[] = {
+		1, 63, 64, 65, 127, 4095, 4096, 4097,
+		262143, 262144, 300000, 16777215, 16777216,
+		TIMER_SPAN(TIMER_LEVELS) - 1,
+		TIMER_SPAN(TIMER_LEVELS),
+		TIMER_SPAN(TIMER_LEVELS) * 3 + 7,
+	};
+	uint64_t steps[] = { 1, 7, 1000, 65536, UINT32_MAX }; /* past the next tick */
+	struct test_timer t[ARR_LEN(delays)];
+
+	for (size_t i = 0; i < ARR_LEN(steps); i++) {
+
+		uint64_t now = 1000;
+		uint64_t end = now + TIMER_SPAN(TIMER_LEVELS) * 4;
+
+		timer_wheel_init(&w, now);
+
+		for (size_t j = 0; j < ARR_LEN(delays); j++) {
+			t[j] = (struct test_timer) {0};
+			timer_init(&(t[j].timer), test_timer_cb, &t[j]);
+			timer_add(&w, &(t[j].timer), now + delays[j]);
+		}
+
+		while (now < end && timer_next(&w) != TIMER_NONE) {
+
+			uint64_t next = timer_next(&w);
+
+			for (size_t j = 0; j < ARR_LEN(delays); j++) {
+				if (timer_pending(&(t[j].timer)) && next > t[j].timer.expires)
+					test_failf("timer_next after expiry: %zu", j);
+			}
+
+			now = next + steps[i] - 1;
+
+			(void) timer_run(&w, now);
+		}
+
+		for (size_t j = 0; j < ARR_LEN(delays); j++) {
+			if (t[j].count != 1 || t[j].fired != 1000 + delays[j])
+				test_failf("step %zu: delay %zu fired %u at %zu",
+					i, j, t[j].count, (size_t)(t[j].fired - 1000));
+		}
+	}
+}
+
+static void
+test_timer_periodic(void)
+{
+	/* Callbacks may reschedule or cancel any timer */
+
+	struct test_timer t1 = { .period = 10 };
+	struct test_timer t2 = { .period = 3000 };
+
+	timer_init(&(t1.timer), test_timer_cb, &t1);
+	timer_init(&(t2.timer), test_timer_cb, &t2);
+
+	timer_add(&w, &(t1.timer), 1010);
+	timer_add(&w, &(t2.timer), 1010);
+
+	assert_ueq(timer_run(&w, 1010), 2);
+	assert_ueq(timer_run(&w, 2000), 99);
+	assert_ueq(t1.count, 100);
+	assert_ueq(t2.count, 1);
+	assert_true(t1.fired == 2000);
+
+	assert_ueq(timer_run(&w, 4010), 202);
+	assert_ueq(t1.count, 301);
+	assert_ueq(t2.count, 2);
+	assert_true(t2.fired == 4010);
+
+	timer_del(&w, &(t1.timer));
+	timer_del(&w, &(t2.timer));
+
+	assert_true(timer_next(&w) == TIMER_NONE);
+}
+
+static void
+test_timer_many(void)
+{
+	/* Timers at the same tick all fire, in any order */
+
+	struct test_timer t[256];
+
+	for (size_t i = 0; i < ARR_LEN(t); i++) {
+		t[i] = (struct test_timer) {0};
+		timer_init(&(t[i].timer), test_timer_cb, &t[i]);
+		timer_add(&w, &(t[i].timer), 1000 + (i % 4) * 5000);
+	}
+
+	for (size_t i = 0; i < ARR_LEN(t); i += 2)
+		timer_del(&w, &(t[i].timer));
+
+	assert_ueq(timer_run(&w, 1000), 0);
+	assert_ueq(timer_run(&w, 6000), 64);
+	assert_ueq(timer_run(&w, 16000), 64);
+
+	for (size_t i = 0; i < ARR_LEN(t); i++) {
+		if (t[i].count != (i % 2) || (t[i].count && t[i].fired != t[i].timer.expires))
+			test_failf("timer %zu fired %u", i, t[i].count);
+	}
+}
+
+static int
+test_init(void)
+{
+	timer_wheel_init(&w, 1000);
+
+	return 0;
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_timer_basic),
+		TESTCASE(test_timer_del),
+		TESTCASE(test_timer_levels),
+		TESTCASE(test_timer_periodic),
+		TESTCASE(test_timer_many),
+	};
+
+	return run_tests(test_init, NULL, tests);
+}
@@ -107,7 +107,10 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    "nick");
 	assert_strcmp(m.host,    "user@host.domain.tld");
-	assert_strcmp(m.params,  "args :trailing");
+	assert_ueq(m.n_params, 2);
+	assert_strcmp(m.params[0], "args");
+	assert_strcmp(m.params[1], "trailing");
+	assert_true(m.trailing);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    4);
 	assert_ueq(m.len_host,    20);
@@ -119,7 +122,11 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    NULL);
 	assert_strcmp(m.host,    NULL);
-	assert_strcmp(m.params,  "arg1 arg2 :  trailing message  ");
+	assert_ueq(m.n_params, 3);
+	assert_strcmp(m.params[0], "arg1");
+	assert_strcmp(m.params[1], "arg2");
+	assert_strcmp(m.params[2], "  trailing message  ");
+	assert_true(m.trailing);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    0);
 	assert_ueq(m.len_host,    0);
@@ -131,7 +138,11 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    "nick");
 	assert_strcmp(m.host,    "host.domain.tld");
-	assert_strcmp(m.params,  "arg1 arg2 arg3");
+	assert_ueq(m.n_params, 3);
+	assert_strcmp(m.params[0], "arg1");
+	assert_strcmp(m.params[1], "arg2");
+	assert_strcmp(m.params[2], "arg3");
+	assert_false(m.trailing);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    4);
 	assert_ueq(m.len_host,    15);
@@ -143,7 +154,11 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    "nick");
 	assert_strcmp(m.host,    NULL);
-	assert_strcmp(m.params,  "arg1 arg2 arg3");
+	assert_ueq(m.n_params, 3);
+	assert_strcmp(m.params[0], "arg1");
+	assert_strcmp(m.params[1], "arg2");
+	assert_strcmp(m.params[2], "arg3");
+	assert_false(m.trailing);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    4);
 	assert_ueq(m.len_host,    0);
@@ -155,7 +170,7 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    "nick");
 	assert_strcmp(m.host,    "user@host.domain.tld");
-	assert_strcmp(m.params,  NULL);
+	assert_ueq(m.n_params, 0);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    4);
 	assert_ueq(m.len_host,    20);
@@ -167,7 +182,13 @@ test_irc_message_parse(void)
 	assert_strcmp(m.command, "CMD");
 	assert_strcmp(m.from,    "nick");
 	assert_strcmp(m.host,    "user@host.domain.tld");
-	assert_strcmp(m.params,  "arg1  arg2  arg3   : trailing");
+	assert_ueq(m.n_params, 4);
+	assert_strcmp(m.params[0], "arg1");
+	assert_strcmp(m.params[1], "arg2");
+	assert_strcmp(m.params[2], "arg3");
+	assert_strcmp(m.params[3], " trailing");
+	assert_ueq(m.len_params[3], 9);
+	assert_true(m.trailing);
 	assert_ueq(m.len_command, 3);
 	assert_ueq(m.len_from,    4);
 	assert_ueq(m.len_host,    20);
@@ -187,12 +208,92 @@ test_irc_message_parse(void)
 #undef CHECK_IRC_MESSAGE_PARSE
 }
 
+static void
+test_irc_message_tags(void)
+{
+	struct irc_message m;
+
+	/* Test tags with prefix */
+	char mesg1[] = "@time=2021-01-01T00:00:00.000Z;+example.com/x=y :nick!user@host CMD arg";
+
+	assert_eq(irc_message_parse(&m, mesg1), 0);
+	assert_strcmp(m.command, "CMD");
+	assert_strcmp(m.from,    "nick");
+	assert_strcmp(m.host,    "user@host");
+	assert_ueq(m.n_params, 1);
+	assert_strcmp(m.params[0], "arg");
+	assert_ueq(m.n_tags, 2);
+	assert_strcmp(m.tags[0].key, "time");
+	assert_strcmp(m.tags[1].key, "+example.com/x");
+	assert_ueq(m.tags[1].len_key, 14);
+	assert_strcmp(irc_message_tag(&m, "+example.com/x"), "y");
+	assert_strcmp(irc_message_tag(&m, "x"), NULL);
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_TIME), "2021-01-01T00:00:00.000Z");
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_MSGID), NULL);
+
+	/* Test valueless tags, empty values, empty tags */
+	char mesg2[] = "@a;b=;;c :nick CMD";
+
+	assert_eq(irc_message_parse(&m, mesg2), 0);
+	assert_strcmp(m.command, "CMD");
+	assert_ueq(m.n_tags, 3);
+	assert_strcmp(irc_message_tag(&m, "a"), "");
+	assert_strcmp(irc_message_tag(&m, "b"), "");
+	assert_strcmp(irc_message_tag(&m, "c"), "");
+	assert_ueq(m.tags[2].len_val, 0);
+
+	/* Test escaped values */
+	char mesg3[] = "@a=x\\:y\\sz\\\\\\r\\n;b=\\q\\;msgid=abc\\ CMD";
+
+	assert_eq(irc_message_parse(&m, mesg3), 0);
+	assert_strcmp(m.command, "CMD");
+	assert_strcmp(irc_message_tag(&m, "a"), "x;y z\\\r\n");
+	assert_ueq(m.tags[0].len_val, 8);
+	assert_strcmp(irc_message_tag(&m, "a"), "x;y z\\\r\n");
+	assert_strcmp(irc_message_tag(&m, "b"), "q");
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_MSGID), "abc");
+
+	/* Test duplicate tags, final value */
+	char mesg4[] = "@batch=1;label=2;batch=3;label CMD";
+
+	assert_eq(irc_message_parse(&m, mesg4), 0);
+	assert_ueq(m.n_tags, 4);
+	assert_strcmp(irc_message_tag(&m, "batch"), "3");
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_BATCH), "3");
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_LABEL), "");
+
+	/* Test tags beyond maximum are ignored */
+	char mesg5[] = "@0;1;2;3;4;5;6;7;8;9;a;b;c;d;e;f;g;h CMD";
+
+	assert_eq(irc_message_parse(&m, mesg5), 0);
+	assert_strcmp(m.command, "CMD");
+	assert_ueq(m.n_tags, IRC_MESSAGE_TAGS_MAX);
+	assert_strcmp(irc_message_tag(&m, "f"), "");
+	assert_strcmp(irc_message_tag(&m, "g"), NULL);
+
+	/* Test untagged message clears tags */
+	char mesg6[] = "CMD";
+
+	assert_eq(irc_message_parse(&m, mesg6), 0);
+	assert_ueq(m.n_tags, 0);
+	assert_strcmp(irc_message_tag(&m, "a"), NULL);
+	assert_strcmp(irc_message_tag_key(&m, IRC_MESSAGE_TAG_BATCH), NULL);
+
+	/* Error: tags only */
+	char mesg7[] = "@a=b;c";
+	assert_eq(irc_message_parse(&m, mesg7), -1);
+
+	/* Error: tags without command */
+	char mesg8[] = "@a=b   ";
+	assert_eq(irc_message_parse(&m, mesg8), -1);
+}
+
 static void
 test_irc_message_split(void)
 {
 	char *param;
-	const char *params;
-	const char *trailing;
+	char *params;
+	char *trailing;
 	struct irc_message m;
 
 #define CHECK_IRC_MESSAGE_PARAM(R, S) \
@@ -221,6 +322,7 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_PARAM(1, "a1");
 	CHECK_IRC_MESSAGE_PARAM(1, "a2");
 	CHECK_IRC_MESSAGE_PARAM(1, "a3");
+	CHECK_IRC_MESSAGE_PARAM(1, "trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test no trailing arg */
@@ -238,6 +340,7 @@ test_irc_message_split(void)
 
 	CHECK_IRC_MESSAGE_PARSE(mesg4, 0);
 	CHECK_IRC_MESSAGE_SPLIT(1, NULL, "trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(1, "trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test ':' can exist in args */
@@ -247,6 +350,7 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_SPLIT(1, "arg:1:2:3 arg:4:5:6", "trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(1, "arg:1:2:3");
 	CHECK_IRC_MESSAGE_PARAM(1, "arg:4:5:6");
+	CHECK_IRC_MESSAGE_PARAM(1, "trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test 15 arg limit */
@@ -269,6 +373,7 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_PARAM(1, "a12");
 	CHECK_IRC_MESSAGE_PARAM(1, "a13");
 	CHECK_IRC_MESSAGE_PARAM(1, "a14");
+	CHECK_IRC_MESSAGE_PARAM(1, "a15 :trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test 15 arg limit - 1 previously parsed */
@@ -291,6 +396,7 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_PARAM(1, "a12");
 	CHECK_IRC_MESSAGE_PARAM(1, "a13");
 	CHECK_IRC_MESSAGE_PARAM(1, "a14");
+	CHECK_IRC_MESSAGE_PARAM(1, "a15 :trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test 15 arg limit - 14 previously parsed */
@@ -312,6 +418,7 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_PARAM(1, "a13");
 	CHECK_IRC_MESSAGE_PARAM(1, "a14");
 	CHECK_IRC_MESSAGE_SPLIT(1, NULL, "a15 :trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(1, "a15 :trailing arg");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 	/* Test 15 arg limit - all previously parsed */
@@ -355,6 +462,28 @@ test_irc_message_split(void)
 	CHECK_IRC_MESSAGE_PARAM(1, "a13");
 	CHECK_IRC_MESSAGE_PARAM(1, "a14");
 	CHECK_IRC_MESSAGE_SPLIT(1, NULL, "a15 :trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(1, "a15 :trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(0, NULL);
+
+	/* Test rejoining args, interleaved with reading params */
+	char mesg11[] = "CMD a1  a2 a3 :trailing arg";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg11, 0);
+	CHECK_IRC_MESSAGE_SPLIT(1, "a1  a2 a3", "trailing arg");
+	CHECK_IRC_MESSAGE_SPLIT(1, "a1  a2 a3", "trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(1, "a1");
+	CHECK_IRC_MESSAGE_PARAM(1, "a2");
+	CHECK_IRC_MESSAGE_SPLIT(1, "a3", "trailing arg");
+	CHECK_IRC_MESSAGE_PARAM(1, "a3");
+	CHECK_IRC_MESSAGE_SPLIT(1, NULL, "trailing arg");
+
+	/* Test empty trailing arg */
+	char mesg12[] = "CMD a1 :";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg12, 0);
+	CHECK_IRC_MESSAGE_SPLIT(1, "a1", NULL);
+	CHECK_IRC_MESSAGE_PARAM(1, "a1");
+	CHECK_IRC_MESSAGE_PARAM(1, "");
 	CHECK_IRC_MESSAGE_PARAM(0, NULL);
 
 #undef CHECK_IRC_MESSAGE_PARAM
@@ -362,63 +491,6 @@ test_irc_message_split(void)
 #undef CHECK_IRC_MESSAGE_SPLIT
 }
 
-static void
-test_irc_pinged(void)
-{
-	/* Test detecting user's nick in message */
-
-	const char *nick;
-
-#define CHECK_IRC_PINGED(M, R) \
-	assert_eq(irc_pinged(CASEMAPPING_RFC1459, (M), nick), (R));
-
-	nick = "nick";
-
-	CHECK_IRC_PINGED("nick", 1);
-	CHECK_IRC_PINGED("nick ", 1);
-	CHECK_IRC_PINGED("nick:", 1);
-	CHECK_IRC_PINGED("nick: ", 1);
-	CHECK_IRC_PINGED(" nick", 1);
-	CHECK_IRC_PINGED(" nick ", 1);
-	CHECK_IRC_PINGED(" nick:", 1);
-	CHECK_IRC_PINGED(" nick: ", 1);
-	CHECK_IRC_PINGED("xxx 'nick'! ", 1);
-	CHECK_IRC_PINGED("xxx @nick?! xxx", 1);
-	CHECK_IRC_PINGED("xxx @NICK?! xxx", 1);
-
-	CHECK_IRC_PINGED("", 0);
-	CHECK_IRC_PINGED(" ", 0);
-	CHECK_IRC_PINGED("xxx", 0);
-	CHECK_IRC_PINGED("xnick", 0);
-	CHECK_IRC_PINGED("xnick:", 0);
-	CHECK_IRC_PINGED("xnick: ", 0);
-	CHECK_IRC_PINGED(" xnick", 0);
-	CHECK_IRC_PINGED(" xnick:", 0);
-
-	/* Test server assigns a non standard nick */
-	nick = "000nick";
-
-	CHECK_IRC_PINGED("000nick", 1);
-	CHECK_IRC_PINGED("000nick ", 1);
-	CHECK_IRC_PINGED("000nick:", 1);
-	CHECK_IRC_PINGED("000nick: ", 1);
-	CHECK_IRC_PINGED(" 000nick", 1);
-	CHECK_IRC_PINGED(" 000nick ", 1);
-	CHECK_IRC_PINGED(" 000nick:", 1);
-	CHECK_IRC_PINGED(" 000nick: ", 1);
-	CHECK_IRC_PINGED("xxx '000nick'! ", 1);
-	CHECK_IRC_PINGED("xxx @000nick?! xxx", 1);
-	CHECK_IRC_PINGED("xxx @000NICK?! xxx", 1);
-
-	CHECK_IRC_PINGED("x000nick", 0);
-	CHECK_IRC_PINGED("x000nick:", 0);
-	CHECK_IRC_PINGED("x000nick: ", 0);
-	CHECK_IRC_PINGED(" x000nick", 0);
-	CHECK_IRC_PINGED(" x000nick:", 0);
-
-#undef CHECK_IRC_PINGED
-}
-
 static void
 test_irc_strcmp(void)
 {
@@ -453,6 +525,48 @@ test_irc_strcmp(void)
 	assert_eq(irc_strcmp(CASEMAPPING_RFC1459, "abc123", "ABC123"), 0);
 	assert_eq(irc_strcmp(CASEMAPPING_STRICT_RFC1459, "abc123", "ABC123"), 0);
 	assert_eq(irc_strcmp(CASEMAPPING_ASCII, "abc123", "ABC123"), 0);
+
+	/* Test comparison at every offset of long strings, for every casemapping
+	 * and character, against the character folding */
+	enum casemapping cms[] = {
+		CASEMAPPING_ASCII,
+		CASEMAPPING_RFC1459,
+		CASEMAPPING_STRICT_RFC1459,
+	};
+
+	for (size_t i = 0; i < ARR_LEN(cms); i++) {
+		for (int c = 1; c < 256; c++) {
+			for (size_t j = 0; j < 40; j += 13) {
+
+				char s1[48] = "abcdefghijklmnopqrstuvwxyz{}|^[]\\~0123456789";
+				char s2[48] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ[]\\~[]\\~0123456789";
+				int ret;
+				int exp;
+
+				if (cms[i] == CASEMAPPING_ASCII)
+					memcpy(s2 + 26, s1 + 26, 8);
+
+				if (cms[i] == CASEMAPPING_STRICT_RFC1459)
+					s2[29] = '^';
+
+				s1[j] = (char)c;
+				exp = irc_toupper(cms[i], s1[j]) - irc_toupper(cms[i], s2[j]);
+
+				if ((ret = irc_strcmp(cms[i], s1, s2)) != -exp)
+					test_failf("casemapping %zu, %d at %zu: %d", i, c, j, ret);
+
+				if ((ret = irc_strncmp(cms[i], s1, s2, 40)) != -exp)
+					test_failf("casemapping %zu, %d at %zu: %d", i, c, j, ret);
+
+				if ((ret = irc_strncmp(cms[i], s1, s2, j)) != 0)
+					test_failf("casemapping %zu, %d at %zu: %d", i, c, j, ret);
+			}
+		}
+	}
+
+	/* Test strings of different length */
+	assert_lt(irc_strcmp(CASEMAPPING_RFC1459, "abcdefghijklmnopqrstuvwxyz", "ABCDEFGHIJKLMNOPQRSTUVWXY"), 0);
+	assert_gt(irc_strcmp(CASEMAPPING_RFC1459, "abcdefghijklmnopqrstuvwxy", "ABCDEFGHIJKLMNOPQRSTUVWXYZ"), 0);
 }
 
 static void
@@ -479,6 +593,108 @@ test_irc_toupper(void)
 	assert_strcmp(str, "*AZ[]\\~[]\\~*");
 }
 
+static void
+test_irc_strline(void)
+{
+	char *p;
+	size_t n;
+
+	/* Test lines filtered in place */
+	char mesg1[] = "abc\r\ndef\n\r\n\x01\tg\x7f\x80h\r\r\ni";
+	char *end1 = mesg1 + sizeof(mesg1) - 1;
+
+	p = mesg1;
+	assert_ptr_eq(irc_strline(p, end1, &n), mesg1 + 5);
+	assert_strncmp(p, "abc", n);
+	assert_ueq(n, 3);
+
+	p = mesg1 + 5;
+	assert_ptr_eq(irc_strline(p, end1, &n), mesg1 + 9);
+	assert_strncmp(p, "def", n);
+	assert_ueq(n, 3);
+
+	p = mesg1 + 9;
+	assert_ptr_eq(irc_strline(p, end1, &n), mesg1 + 11);
+	assert_ueq(n, 0);
+
+	p = mesg1 + 11;
+	assert_ptr_eq(irc_strline(p, end1, &n), mesg1 + 20);
+	assert_strncmp(p, "\x01g\x80h", n);
+	assert_ueq(n, 4);
+
+	/* Test no line terminator */
+	assert_ptr_null(irc_strline(mesg1 + 20, end1, &n));
+	assert_ptr_null(irc_strline(end1, end1, &n));
+
+	/* Test filtered and retained bytes at every offset of long lines */
+	for (size_t i = 0; i < 100; i++) {
+
+		char buf[128];
+		char exp[128];
+		size_t len = 0;
+
+		for (size_t j = 0; j < 100; j++) {
+			buf[j] = (char)('0' + (j % 64));
+			if (j == i && i % 3 == 0)
+				buf[j] = (char)0xFF;
+			if (j != i || i % 3 == 0)
+				exp[len++] = buf[j];
+		}
+
+		if (i % 3)
+			buf[i] = (char)((i % 3 == 1) ? 0x7F : '\r');
+		buf[100] = '\n';
+
+		if (irc_strline(buf, buf + sizeof(buf), &n) != buf + 101)
+			test_failf("line terminator: %zu", i);
+		else if (n != len || memcmp(buf, exp, len))
+			test_failf("filtered byte: %zu", i);
+	}
+}
+
+static void
+test_irc_strlist(void)
+{
+	char *p;
+
+	char list1[] = "";
+
+	assert_ptr_null(irc_strlist(NULL, 0, 0));
+
+	p = list1;
+	assert_ptr_null(irc_strlist(&p, 0, 0));
+
+	/* Test unlimited */
+	char list2[] = "a,bb,ccc";
+	p = list2;
+	assert_strcmp(irc_strlist(&p, 0, SIZE_MAX), "a,bb,ccc");
+	assert_ptr_null(irc_strlist(&p, 0, SIZE_MAX));
+
+	/* Test elements per list */
+	char list3[] = "a,bb,ccc,dddd,e";
+	p = list3;
+	assert_strcmp(irc_strlist(&p, 2, SIZE_MAX), "a,bb");
+	assert_strcmp(irc_strlist(&p, 2, SIZE_MAX), "ccc,dddd");
+	assert_strcmp(irc_strlist(&p, 2, SIZE_MAX), "e");
+	assert_ptr_null(irc_strlist(&p, 2, SIZE_MAX));
+
+	char list4[] = "a,bb,ccc";
+	p = list4;
+	assert_strcmp(irc_strlist(&p, 1, SIZE_MAX), "a");
+	assert_strcmp(irc_strlist(&p, 1, SIZE_MAX), "bb");
+	assert_strcmp(irc_strlist(&p, 1, SIZE_MAX), "ccc");
+	assert_ptr_null(irc_strlist(&p, 1, SIZE_MAX));
+
+	/* Test length per list, first element is returned if longer */
+	char list5[] = "aaaaa,b,c,ddd,e,f";
+	p = list5;
+	assert_strcmp(irc_strlist(&p, 0, 3), "aaaaa");
+	assert_strcmp(irc_strlist(&p, 0, 3), "b,c");
+	assert_strcmp(irc_strlist(&p, 0, 3), "ddd");
+	assert_strcmp(irc_strlist(&p, 2, 3), "e,f");
+	assert_ptr_null(irc_strlist(&p, 0, 3));
+}
+
 static void
 test_irc_strsep(void)
 {
@@ -541,6 +757,50 @@ test_irc_strtrim(void)
 	assert_strcmp(mesg4, "");
 }
 
+static void
+test_irc_strutf8(void)
+{
+	char buf[16];
+
+	/* Test valid UTF-8 passed through */
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xc3\xa9\xe2\x82\xac", 6, CHARSET_UTF8), 6);
+	assert_strcmp(buf, "a\xc3\xa9\xe2\x82\xac");
+
+	/* Test invalid bytes transcoded per charset */
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xe9\x80" "b", 4, CHARSET_UTF8), 8);
+	assert_strcmp(buf, "a\xef\xbf\xbd\xef\xbf\xbd" "b");
+
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xe9\x80" "b", 4, CHARSET_LATIN1), 7);
+	assert_strcmp(buf, "a\xc3\xa9\xef\xbf\xbd" "b");
+
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xe9 \x80\x81" "b", 6, CHARSET_CP1252), 11);
+	assert_strcmp(buf, "a\xc3\xa9 \xe2\x82\xac\xef\xbf\xbd" "b");
+
+	/* Test truncated sequences transcoded bytewise */
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "\xe2\x82", 2, CHARSET_LATIN1), 5);
+	assert_strcmp(buf, "\xc3\xa2\xef\xbf\xbd");
+
+	/* Test C1 controls replaced */
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xc2\x9b" "b\xc2\xa0", 6, CHARSET_UTF8), 7);
+	assert_strcmp(buf, "a\xef\xbf\xbd" "b\xc2\xa0");
+
+	assert_ueq(irc_strutf8(buf, sizeof(buf), "a\xc2\x85" "b", 4, CHARSET_LATIN1), 5);
+	assert_strcmp(buf, "a\xef\xbf\xbd" "b");
+
+	/* Test truncation at a character */
+	assert_ueq(irc_strutf8(buf, 4, "ab\xc3\xa9", 4, CHARSET_UTF8), 2);
+	assert_strcmp(buf, "ab");
+
+	assert_ueq(irc_strutf8(buf, 4, "a\xc3\xa9", 3, CHARSET_UTF8), 3);
+	assert_strcmp(buf, "a\xc3\xa9");
+
+	assert_ueq(irc_strutf8(buf, 4, "ab\xe9", 3, CHARSET_LATIN1), 2);
+	assert_strcmp(buf, "ab");
+
+	assert_ueq(irc_strutf8(buf, 1, "ab", 2, CHARSET_UTF8), 0);
+	assert_strcmp(buf, "");
+}
+
 static void
 test_irc_strwrap(void)
 {
@@ -652,6 +912,98 @@ test_irc_strwrap(void)
 	*ret = '!';
 	assert_strcmp(seg1, " te!ting");
 	assert_strcmp(seg2, "!ting");
+
+	/* Test multibyte characters counted as single columns */
+	char m5[] = "\xc3\xa9t\xc3\xa9 \xe2\x82\xac\xe2\x82\xac";
+
+	end = m5 + strlen(m5);
+	seg1 = seg2 = m5;
+	ret = irc_strwrap(6, &seg2, end);
+	if (ret != end || seg2 != end)
+		test_fail("multibyte string should fit");
+
+	seg1 = seg2 = m5;
+	ret = irc_strwrap(5, &seg2, end);
+	*ret = 0;
+	assert_strcmp(seg1, "\xc3\xa9t\xc3\xa9");
+	assert_strcmp(seg2, "\xe2\x82\xac\xe2\x82\xac");
+
+	/* Test nowhere to wrap splits between multibyte characters */
+	char m6[] = "\xe2\x82\xac\xe2\x82\xac\xe2\x82\xac";
+
+	end = m6 + strlen(m6);
+	seg1 = seg2 = m6;
+	ret = irc_strwrap(2, &seg2, end);
+	if (ret != m6 + 6 || seg2 != m6 + 6)
+		test_fail("multibyte string should split after 2 characters");
+}
+
+static void
+test_irc_utf8_valid(void)
+{
+	/* RFC 3629, section 4 */
+	const char *valid[] = {
+		"",
+		"ascii",
+		"\xc2\xa0",
+		"\xdf\xbf",
+		"\xe0\xa0\x80",
+		"\xed\x9f\xbf",
+		"\xee\x80\x80",
+		"\xef\xbf\xbf",
+		"\xf0\x90\x80\x80",
+		"\xf4\x8f\xbf\xbf",
+	};
+	const char *invalid[] = {
+		"\x80",         /* continuation */
+		"\xbf",
+		"\xc0\x80",     /* overlong */
+		"\xc1\xbf",
+		"\xc2\x80",   /* C1 control */
+		"\xc2\x9f",
+		"\xe0\x9f\xbf",
+		"\xf0\x8f\xbf\xbf",
+		"\xed\xa0\x80", /* surrogate */
+		"\xf4\x90\x80\x80", /* > U+10FFFF */
+		"\xf5\x80\x80\x80",
+		"\xff",
+		"\xc3",         /* truncated */
+		"\xe2\x82",
+		"\xf0\x9f\x98",
+		"\xc3" "a",
+		"\xe2\x82" "a",
+	};
+
+	for (size_t i = 0; i < ARR_LEN(valid); i++) {
+		if (irc_utf8_valid(valid[i], strlen(valid[i])) != strlen(valid[i]))
+			test_failf("valid: %zu", i);
+	}
+
+	for (size_t i = 0; i < ARR_LEN(invalid); i++) {
+		if (irc_utf8_valid(invalid[i], strlen(invalid[i])) != 0)
+			test_failf("invalid: %zu", i);
+	}
+
+	/* Test invalid bytes at every offset of long strings */
+	for (size_t i = 0; i < 100; i++) {
+
+		char buf[101];
+
+		for (size_t j = 0; j < 100; j++)
+			buf[j] = (char)('0' + (j % 64));
+
+		buf[i] = (char)0x80;
+
+		if (irc_utf8_valid(buf, 100) != i)
+			test_failf("invalid byte: %zu", i);
+
+		/* Multibyte characters before the invalid byte */
+		if (i >= 3) {
+			memcpy(buf, "\xe2\x82\xac", 3);
+			if (irc_utf8_valid(buf, 100) != i)
+				test_failf("multibyte, invalid byte: %zu", i);
+		}
+	}
 }
 
 int
@@ -663,13 +1015,17 @@ main(void)
 		TESTCASE(test_irc_message_param),
 		TESTCASE(test_irc_message_parse),
 		TESTCASE(test_irc_message_split),
-		TESTCASE(test_irc_pinged),
+		TESTCASE(test_irc_message_tags),
 		TESTCASE(test_irc_strcmp),
 		TESTCASE(test_irc_strncmp),
+		TESTCASE(test_irc_strline),
+		TESTCASE(test_irc_strlist),
 		TESTCASE(test_irc_strsep),
 		TESTCASE(test_irc_strtrim),
+		TESTCASE(test_irc_strutf8),
 		TESTCASE(test_irc_strwrap),
-		TESTCASE(test_irc_toupper)
+		TESTCASE(test_irc_toupper),
+		TESTCASE(test_irc_utf8_valid)
 	};
 
 	return run_tests(NULL, NULL, tests);